@@ -129,6 +129,7 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelay				1
 #define INCLUDE_pcTaskGetTaskName			1
 #define INCLUDE_uxTaskGetStackHighWaterMark	1
+#define INCLUDE_xTaskGetCurrentTaskHandle	1
 
 /* Cortex-M specific definitions. */
 #ifdef __NVIC_PRIO_BITS
@@ -0,0 +1,771 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup sim_cell Simulated cell
+ * @brief Model of the belts, dispatchers and arms behind the CAN bus, replaces the CAN driver of the BSP
+ *
+ * CARME_CAN_Write hands each frame to the addressed station of the topology, which answers status requests
+ * and starts the commanded motions. The model is event driven: the bus task sleeps until the next event (a
+ * delivery, the front block of a running belt reaching its stop, the end of a motion of an arm or dispatcher,
+ * the operator) or until a frame is written. Then it moves the blocks between the stations and delivers the
+ * answers and the transmit completions through the interrupt callbacks registered by ucan. The belts are
+ * advanced lazily to the current tick whenever they are looked at. All times are virtual ticks of 1 ms. At the
+ * end of the run the throughput, the utilization of every station and the number of blocks waiting on each belt
+ * are reported.
+ */
+/*@{*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <can.h>
+#include "topology.h"
+#include "airspace.h"
+#include "sim.h"
+
+// -------------------- Configuration  ------------
+#define SIM_LATENCY         1 //!< Time in ticks until a frame is answered and acknowledged
+#define SIM_PRIORITY        (configMAX_PRIORITIES - 1) //!< Priority of the bus task, above all firmware tasks
+#define SIM_STACKSIZE       256 //!< Stack size of the bus task
+#define SIM_FIFO_SIZE       64 //!< Receive fifo of the chip
+#define SIM_PENDING_SIZE    64 //!< Frames and transmit completions which wait on their delivery
+
+#define BELT_MAX_BLOCKS     4 //!< Max number of blocks on a belt
+#define BELT_BLOCK_LEN      0x30 //!< Length of a block in position units. The drop zone is occupied while a block is closer to the start
+#define BELT_SENSOR_POS     0x60 //!< Position of the block detection
+#define BELT_BARRIER_POS    0xB4 //!< Position from which the light barrier at the end sees a block
+#define BELT_END_POS        0xC0 //!< End of a belt, blocks beyond fall off
+#define BELT_LOCATIONS      7 //!< Lateral locations of a block: -3..3
+#define OPERATOR_PERIOD     2000 //!< Time in ticks the operator needs to place the next block
+#define OPERATOR_POLL       10 //!< Time in ticks the operator waits for a free drop zone on the feeder
+#define SIM_STALL_TIME      60000 //!< Time in ticks without a delivered block after which the cell is reported as stuck
+
+#define GRIPPER_OPEN        0x01 //!< Gripper value of an open gripper
+
+
+// ------------------ Implementation ------------------------
+
+/**
+ * @brief A belt with its blocks
+ */
+typedef struct {
+    uint16_t pos[BELT_MAX_BLOCKS]; //!< Positions of the blocks, front block first
+    int8_t location[BELT_MAX_BLOCKS]; //!< Lateral locations of the blocks
+    uint8_t count; //!< Number of blocks on the belt
+    bool engine; //!< Belt running
+    uint16_t stop_pos; //!< The belt stops when the front block reaches this position
+    uint32_t speed; //!< Speed of the current run in units per second
+    uint32_t progress; //!< Fraction of a unit moved, in 1/1000
+    TickType_t updated; //!< Tick up to which the belt was advanced
+    TickType_t busy; //!< Time the engine was running
+    uint64_t depth_sum; //!< Integral of the block count over the time, in blocks * ticks
+    uint8_t depth_max; //!< Max number of blocks on the belt
+    uint32_t arrivals; //!< Blocks dropped onto the belt
+} sim_belt_t;
+
+/**
+ * @brief A dispatcher at the end of a belt
+ */
+typedef struct {
+    bool pushing; //!< Push in progress
+    uint8_t target; //!< Target index of the push in the dispatcher structure
+    TickType_t done; //!< End of the current motion
+    TickType_t busy; //!< Time spent moving
+} sim_dispatcher_t;
+
+/**
+ * @brief A robot arm
+ */
+typedef struct {
+    uint8_t from[TOPOLOGY_AXES]; //!< Position at the start of the current motion
+    uint8_t to[TOPOLOGY_AXES]; //!< Target of the current motion
+    TickType_t start; //!< Start of the current motion
+    TickType_t end; //!< End of the current motion
+    bool arrived; //!< The end of the current motion was processed
+    bool holding; //!< A block is in the gripper
+    TickType_t busy; //!< Time spent moving
+    uint32_t delivered; //!< Blocks dropped onto the target belt
+} sim_arm_t;
+
+/**
+ * @brief A frame or a transmit completion which waits on its delivery
+ */
+typedef struct {
+    TickType_t due; //!< Tick of the delivery
+    bool transmitted; //!< Transmit completion instead of a received frame
+    CARME_CAN_MESSAGE msg; //!< The received frame
+} sim_pending_t;
+
+/**
+ * @brief Counters of the faults
+ */
+typedef struct {
+    uint32_t frames; //!< Frames written by ucan
+    uint32_t frames_lost; //!< Frames not acknowledged (fault injection)
+    uint32_t fifo_overruns; //!< Frames lost because the receive fifo was full
+    uint32_t blocks_lost; //!< Blocks which fell off a belt (fault injection or overrun end)
+    uint32_t collisions; //!< Blocks dropped onto an occupied drop zone
+    uint32_t missed_picks; //!< Grabs or pushes without a block at the end of the belt
+} sim_faults_t;
+
+static sim_belt_t belts[TOPOLOGY_MAX_BELTS]; //!< State of the belts
+static sim_dispatcher_t dispatchers[TOPOLOGY_MAX_BELTS]; //!< State of the dispatchers, by belt
+static sim_arm_t arms[TOPOLOGY_MAX_ARMS]; //!< State of the arms
+static sim_faults_t faults; //!< Fault counters
+
+static CARME_CAN_MESSAGE fifo[SIM_FIFO_SIZE]; //!< Receive fifo of the chip
+static uint8_t fifo_head; //!< Next frame to read
+static uint8_t fifo_count; //!< Frames in the fifo
+static sim_pending_t pending[SIM_PENDING_SIZE]; //!< Deliveries in the order of their due tick
+static uint8_t pending_count; //!< Number of deliveries
+
+static IRQ_CALLBACK callbacks[CARME_CAN_IRQID_COUNT]; //!< Interrupt callbacks of ucan
+
+static uint8_t operator_placed; //!< Blocks placed onto the feeder by the operator
+static TickType_t operator_next; //!< Earliest time for the next block
+static TickType_t last_delivery; //!< Tick of the last block an arm dropped onto its target
+static TaskHandle_t bus_task; //!< The bus task, notified when a frame is written
+static struct timespec real_start; //!< Wall clock at the start, for the speed
+
+
+/**
+ * @brief       Returns a random number
+ * @type        global
+ * @param[in]   range   Number of possible values
+ * @return      A number between 0 and range - 1
+ **/
+uint32_t sim_random(uint32_t range)
+{
+    return range > 0 ? (uint32_t)rand() % range : 0;
+}
+
+/**
+ * @brief       Applies the jitter to a motion time
+ * @type        static
+ * @param[in]   time    Nominal time
+ * @return      The time with a random variation of +- \ref sim_config_t.jitter percent
+ **/
+static uint32_t sim_jitter(uint32_t time)
+{
+    return time * (100 - sim_config.jitter + sim_random(2 * sim_config.jitter + 1)) / 100;
+}
+
+/**
+ * @brief       Queues a frame or a transmit completion for its delivery after \ref SIM_LATENCY
+ * @type        static
+ * @param[in]   transmitted true for a transmit completion
+ * @param[in]   msg         The received frame (NULL for a transmit completion)
+ * @return      none
+ **/
+static void sim_schedule(bool transmitted, const CARME_CAN_MESSAGE* msg)
+{
+    if(pending_count >= SIM_PENDING_SIZE) {
+        faults.fifo_overruns++;
+        return;
+    }
+    sim_pending_t* entry = &pending[pending_count++];
+    entry->due = xTaskGetTickCount() + SIM_LATENCY;
+    entry->transmitted = transmitted;
+    if(msg != NULL) {
+        entry->msg = *msg;
+    }
+}
+
+/**
+ * @brief       Sends a frame of a station to ucan
+ * @type        static
+ * @param[in]   id      Id of the frame
+ * @param[in]   dlc     Number of data bytes
+ * @param[in]   data    The data bytes
+ * @return      none
+ **/
+static void sim_respond(uint16_t id, uint8_t dlc, const void* data)
+{
+    CARME_CAN_MESSAGE msg = {.id = id, .dlc = dlc};
+    memcpy(msg.data, data, dlc);
+    sim_schedule(false, &msg);
+}
+
+/**
+ * @brief       Drops a block onto the start of a belt
+ * @type        static
+ * @param[in]   belt    The belt
+ * @return      none
+ **/
+static void sim_belt_drop(belt_id_t belt)
+{
+    sim_belt_t* b = &belts[belt];
+
+    if(sim_random(1000) < sim_config.block_loss) {
+        faults.blocks_lost++;
+        return;
+    }
+    if(b->count >= BELT_MAX_BLOCKS || (b->count > 0 && b->pos[b->count - 1] < BELT_BLOCK_LEN)) {
+        faults.collisions++;
+        return;
+    }
+    b->pos[b->count] = 0;
+    b->location[b->count] = (int8_t)sim_random(BELT_LOCATIONS) - BELT_LOCATIONS / 2;
+    b->count++;
+    b->arrivals++;
+}
+
+/**
+ * @brief       Takes the front block from the end of a belt
+ * @type        static
+ * @param[in]   belt    The belt
+ * @return      true if there was a block at the end
+ **/
+static bool sim_belt_take(belt_id_t belt)
+{
+    sim_belt_t* b = &belts[belt];
+
+    if(b->count == 0 || b->engine || b->pos[0] < BELT_SENSOR_POS) {
+        faults.missed_picks++;
+        return false;
+    }
+    b->count--;
+    memmove(&b->pos[0], &b->pos[1], b->count * sizeof(b->pos[0]));
+    memmove(&b->location[0], &b->location[1], b->count * sizeof(b->location[0]));
+    return true;
+}
+
+/**
+ * @brief       Advances a belt to the current tick. The front block stops the belt at the stop position, the others keep their distance.
+ * @type        static
+ * @param[in]   belt    The belt
+ * @param[in]   now     Current tick
+ * @return      none
+ **/
+static void sim_belt_advance(belt_id_t belt, TickType_t now)
+{
+    sim_belt_t* b = &belts[belt];
+    TickType_t elapsed = now - b->updated;
+
+    b->updated = now;
+    b->depth_sum += (uint64_t)b->count * elapsed;
+    if(b->count > b->depth_max) {
+        b->depth_max = b->count;
+    }
+    if(!b->engine || elapsed == 0) {
+        return;
+    }
+
+    b->busy += elapsed;
+    b->progress += b->speed * elapsed;
+    uint32_t units = b->progress / 1000;
+    b->progress %= 1000;
+
+    for(uint8_t i = 0; i < b->count; i++) {
+        uint32_t pos = b->pos[i] + units;
+        if(i == 0 && b->pos[0] < b->stop_pos && pos >= b->stop_pos) {
+            pos = b->stop_pos;
+            b->engine = false;
+        } else if(i > 0 && pos > b->pos[i - 1] - BELT_BLOCK_LEN) {
+            pos = b->pos[i - 1] - BELT_BLOCK_LEN;
+        }
+        b->pos[i] = pos > BELT_END_POS + 1 ? BELT_END_POS + 1 : pos;
+    }
+    if(b->count > 0 && b->pos[0] > BELT_END_POS) { //no stop position, the block falls off
+        faults.blocks_lost++;
+        b->engine = false;
+        sim_belt_take(belt);
+    }
+}
+
+/**
+ * @brief       Returns the time until the front block of a running belt reaches its stop position or falls off
+ * @type        static
+ * @param[in]   belt    The belt
+ * @return      Time in ticks, portMAX_DELAY if there is no such event
+ **/
+static TickType_t sim_belt_next(belt_id_t belt)
+{
+    sim_belt_t* b = &belts[belt];
+
+    if(!b->engine || b->count == 0 || b->speed == 0) {
+        return portMAX_DELAY;
+    }
+    uint32_t target = b->pos[0] < b->stop_pos ? b->stop_pos : BELT_END_POS + 1;
+    uint32_t distance = (target - b->pos[0]) * 1000 - b->progress;
+    return (distance + b->speed - 1) / b->speed;
+}
+
+/**
+ * @brief       Handles a frame to a belt
+ * @type        static
+ * @param[in]   belt    The belt
+ * @param[in]   msg     The frame
+ * @return      none
+ **/
+static void sim_belt_frame(belt_id_t belt, const CARME_CAN_MESSAGE* msg)
+{
+    sim_belt_t* b = &belts[belt];
+    uint16_t base = topology_belts[belt].can_base;
+
+    sim_belt_advance(belt, xTaskGetTickCount());
+    switch(msg->id - base) {
+    case 0x0: { //status request, answered with the status_t of bcs.c
+        bool block = b->count > 0;
+        struct __attribute__((__packed__)) {
+            uint8_t error, engine, lightbarrier, detection;
+            uint16_t position;
+            int8_t location;
+        } status = {
+            .engine = b->engine,
+            .lightbarrier = block && b->pos[0] >= BELT_BARRIER_POS,
+            .detection = block && b->pos[0] >= BELT_SENSOR_POS ? 3 : 0,
+            .position = block ? b->pos[0] : 0,
+            .location = block ? b->location[0] : 0,
+        };
+        sim_respond(base + 0x1, sizeof(status), &status);
+        break;
+    }
+    case 0x2: //command
+        switch(msg->data[0]) {
+        case 1: //start
+            b->engine = true;
+            b->speed = sim_jitter(sim_config.belt_speed);
+            break;
+        case 3: //stop position
+            b->stop_pos = (msg->data[1] << 8) | msg->data[2];
+            break;
+        default: //stop, done
+            b->engine = false;
+            break;
+        }
+        break;
+    case 0xF: //reset
+        b->engine = false;
+        b->stop_pos = BELT_END_POS;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief       Handles a command to a dispatcher. A move command pushes the block at the end of the belt onto the target.
+ * @type        static
+ * @param[in]   belt    The belt of the dispatcher
+ * @param[in]   msg     The frame
+ * @return      none
+ **/
+static void sim_dispatcher_frame(belt_id_t belt, const CARME_CAN_MESSAGE* msg)
+{
+    const topology_dispatcher_t* info = topology_belts[belt].dispatcher;
+    sim_dispatcher_t* d = &dispatchers[belt];
+    uint32_t time = sim_jitter(sim_config.dispatcher_time);
+
+    d->done = xTaskGetTickCount() + time;
+    d->busy += time;
+    for(uint8_t t = 0; t < info->target_count; t++) {
+        if(memcmp(msg->data, info->cmd_move[t], 3) == 0) {
+            d->pushing = true;
+            d->target = t;
+        }
+    }
+}
+
+/**
+ * @brief       Returns the current position of an arm
+ * @type        static
+ * @param[in]   arm     The arm
+ * @param[in]   now     Current tick
+ * @param[out]  pos     The position (one value per axis)
+ * @return      none
+ **/
+static void sim_arm_position(arm_id_t arm, TickType_t now, uint8_t pos[TOPOLOGY_AXES])
+{
+    sim_arm_t* a = &arms[arm];
+
+    for(uint8_t i = 0; i < TOPOLOGY_AXES; i++) {
+        if(now >= a->end) {
+            pos[i] = a->to[i];
+        } else {
+            pos[i] = (int8_t)a->from[i] + ((int8_t)a->to[i] - (int8_t)a->from[i]) * (int32_t)(now - a->start) / (int32_t)(a->end - a->start);
+        }
+    }
+}
+
+/**
+ * @brief       Handles a frame to an arm
+ * @type        static
+ * @param[in]   arm     The arm
+ * @param[in]   msg     The frame
+ * @return      none
+ **/
+static void sim_arm_frame(arm_id_t arm, const CARME_CAN_MESSAGE* msg)
+{
+    sim_arm_t* a = &arms[arm];
+    uint16_t base = topology_arms[arm].can_base;
+    TickType_t now = xTaskGetTickCount();
+    uint8_t pos[TOPOLOGY_AXES];
+
+    sim_arm_position(arm, now, pos);
+    switch(msg->id - base) {
+    case 0x0: //status request
+        sim_respond(base + 0x1, TOPOLOGY_AXES, pos);
+        break;
+    case 0x2: { //move
+        uint32_t time = 0;
+        for(uint8_t i = 1; i < TOPOLOGY_AXES - 1; i++) {
+            uint32_t joint = abs((int8_t)msg->data[i] - (int8_t)pos[i]) * 1000 / sim_config.arm_speed; //the joints are signed
+            time = joint > time ? joint : time;
+        }
+        if(msg->data[TOPOLOGY_AXES - 1] != pos[TOPOLOGY_AXES - 1]) {
+            time += sim_config.gripper_time;
+        }
+        time = sim_jitter(time) + 1;
+        memcpy(a->from, pos, TOPOLOGY_AXES);
+        memcpy(a->to, msg->data, TOPOLOGY_AXES);
+        a->start = now;
+        a->end = now + time;
+        a->arrived = false;
+        a->busy += time;
+        break;
+    }
+    case 0xF: //reset: stop where we are
+        memcpy(a->from, pos, TOPOLOGY_AXES);
+        memcpy(a->to, pos, TOPOLOGY_AXES);
+        a->end = now;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief       Processes the end of the motion of an arm: closing the gripper takes the block from the source belt, opening it drops the block onto the target
+ * @type        static
+ * @param[in]   arm     The arm
+ * @param[in]   now     Current tick
+ * @return      none
+ **/
+static void sim_arm_step(arm_id_t arm, TickType_t now)
+{
+    sim_arm_t* a = &arms[arm];
+    const topology_arm_t* info = &topology_arms[arm];
+    uint8_t gripper = TOPOLOGY_AXES - 1;
+
+    if(a->arrived || now < a->end) {
+        return;
+    }
+    a->arrived = true;
+    if(a->from[gripper] == GRIPPER_OPEN && a->to[gripper] != GRIPPER_OPEN) {
+        a->holding = sim_belt_take(info->source);
+    } else if(a->from[gripper] != GRIPPER_OPEN && a->to[gripper] == GRIPPER_OPEN && a->holding) {
+        a->holding = false;
+        a->delivered++;
+        last_delivery = now;
+        sim_belt_drop(info->target);
+    }
+}
+
+/**
+ * @brief       Checks whether an arm carries a block to a belt, the operator does not place a block under it
+ * @type        static
+ * @param[in]   belt    The belt
+ * @return      true if an arm holds a block for the belt
+ **/
+static bool sim_arm_carries_to(belt_id_t belt)
+{
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        if(arms[arm].holding && topology_arms[arm].target == belt) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief       Processes the events of the cell which are due
+ * @type        static
+ * @param[in]   now     Current tick
+ * @return      none
+ **/
+static void sim_step(TickType_t now)
+{
+    for(belt_id_t belt = 0; belt < topology_belt_count; belt++) {
+        sim_belt_advance(belt, now);
+    }
+    for(belt_id_t belt = 0; belt < topology_belt_count; belt++) {
+        const topology_dispatcher_t* info = topology_belts[belt].dispatcher;
+        sim_dispatcher_t* d = &dispatchers[belt];
+        if(d->pushing && now >= d->done) {
+            d->pushing = false;
+            if(sim_belt_take(belt)) {
+                sim_belt_drop(info->targets[d->target]);
+            }
+        }
+
+        /* The operator places the first blocks onto the feeder, each one once the previous one was moved away (design/index.md) */
+        sim_belt_t* b = &belts[belt];
+        if(topology_belts[belt].feeder && operator_placed < sim_config.blocks && now >= operator_next && b->count == 0 &&
+                !sim_arm_carries_to(belt)) {
+            operator_placed++;
+            operator_next = now + OPERATOR_PERIOD;
+            sim_belt_drop(belt);
+        }
+    }
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        sim_arm_step(arm, now);
+    }
+}
+
+/**
+ * @brief       Returns the time until the next event of the cell
+ * @type        static
+ * @param[in]   now     Current tick
+ * @return      Time in ticks, at most until the end of the run
+ **/
+static TickType_t sim_next_event(TickType_t now)
+{
+    TickType_t next = sim_config.duration > now ? sim_config.duration - now : 0;
+
+    for(uint8_t i = 0; i < pending_count; i++) {
+        TickType_t due = pending[i].due > now ? pending[i].due - now : 0;
+        next = due < next ? due : next;
+    }
+    for(belt_id_t belt = 0; belt < topology_belt_count; belt++) {
+        TickType_t stop = sim_belt_next(belt);
+        next = stop < next ? stop : next;
+        if(dispatchers[belt].pushing) {
+            TickType_t done = dispatchers[belt].done > now ? dispatchers[belt].done - now : 0;
+            next = done < next ? done : next;
+        }
+    }
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        if(!arms[arm].arrived) {
+            TickType_t end = arms[arm].end > now ? arms[arm].end - now : 0;
+            next = end < next ? end : next;
+        }
+    }
+    if(operator_placed < sim_config.blocks) {
+        TickType_t place = operator_next > now ? operator_next - now : OPERATOR_POLL;
+        next = place < next ? place : next;
+    }
+    return next;
+}
+
+/**
+ * @brief       Delivers the frames and transmit completions which are due, through the interrupt callbacks
+ * @type        static
+ * @param[in]   now     Current tick
+ * @return      none
+ **/
+static void sim_deliver(TickType_t now)
+{
+    bool received = false;
+    bool transmitted = false;
+
+    taskENTER_CRITICAL();
+    uint8_t kept = 0;
+    for(uint8_t i = 0; i < pending_count; i++) {
+        if(pending[i].due > now) {
+            pending[kept++] = pending[i];
+        } else if(pending[i].transmitted) {
+            transmitted = true;
+        } else if(fifo_count < SIM_FIFO_SIZE) {
+            fifo[(fifo_head + fifo_count++) % SIM_FIFO_SIZE] = pending[i].msg;
+            received = true;
+        } else {
+            faults.fifo_overruns++;
+        }
+    }
+    pending_count = kept;
+    taskEXIT_CRITICAL();
+
+    if(transmitted && callbacks[CARME_CAN_IRQID_TX_INTERRUPT] != NULL) {
+        callbacks[CARME_CAN_IRQID_TX_INTERRUPT]();
+    }
+    if(received && callbacks[CARME_CAN_IRQID_RX_INTERRUPT] != NULL) {
+        callbacks[CARME_CAN_IRQID_RX_INTERRUPT]();
+    }
+}
+
+/**
+ * @brief       Prints the results of the run
+ * @type        static
+ * @param[in]   now     Current tick
+ * @return      none
+ **/
+static void sim_report(TickType_t now)
+{
+    struct timespec real_end;
+    clock_gettime(CLOCK_MONOTONIC, &real_end);
+    double real = (real_end.tv_sec - real_start.tv_sec) + (real_end.tv_nsec - real_start.tv_nsec) / 1e9;
+    double hours = now / 3600000.0;
+    uint32_t delivered = 0;
+
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        delivered += arms[arm].delivered;
+    }
+
+    printf("\nSimulated %.1f s in %.1f s (%.0fx real time), %u blocks, switches 0x%02x\n",
+           now / 1000.0, real, real > 0 ? now / 1000.0 / real : 0, sim_config.blocks, sim_config.switches);
+    printf("Throughput: %u blocks, %.1f blocks/hour\n", delivered, delivered / hours);
+    if(now - last_delivery > SIM_STALL_TIME) {
+        printf("Stuck: no block delivered since %.1f s. Tasks waiting without a timeout:\n", last_delivery / 1000.0);
+        sim_print_tasks();
+    }
+    printf("\n");
+    printf("%-12s %6s %8s %10s %10s\n", "Station", "util", "blocks", "avg queue", "max queue");
+    for(belt_id_t belt = 0; belt < topology_belt_count; belt++) {
+        sim_belt_t* b = &belts[belt];
+        printf("%-12s %5.1f%% %8u %10.2f %10u\n", topology_belts[belt].name, 100.0 * b->busy / now, b->arrivals,
+               (double)b->depth_sum / now, b->depth_max);
+        if(topology_belts[belt].dispatcher != NULL) {
+            printf("%-12s %5.1f%%\n", "  dispatcher", 100.0 * dispatchers[belt].busy / now);
+        }
+    }
+    printf("\n%-12s %6s %8s %10s\n", "Arm", "util", "blocks", "air wait");
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        printf("%-12s %5.1f%% %8u %9.1f%%\n", topology_arms[arm].name, 100.0 * arms[arm].busy / now, arms[arm].delivered,
+               100.0 * airspace_get_wait(arm) / now);
+    }
+    printf("\nFrames %u, not acknowledged %u, fifo overruns %u\n", faults.frames, faults.frames_lost, faults.fifo_overruns);
+    printf("Blocks lost %u, collisions %u, missed picks %u\n", faults.blocks_lost, faults.collisions, faults.missed_picks);
+}
+
+/**
+ * @brief       Task which processes the events of the cell and delivers the frames, ends the run after \ref sim_config_t.duration
+ * @type        static
+ * @param[in]   pv_data     Not used
+ * @return      None
+ **/
+static void sim_bus_task(void *pv_data)
+{
+    while(true) {
+        TickType_t now = xTaskGetTickCount();
+
+        sim_step(now);
+        sim_deliver(now);
+
+        if(now >= sim_config.duration) {
+            sim_report(now);
+            fflush(stdout);
+            exit(EXIT_SUCCESS);
+        }
+        ulTaskNotifyTake(pdTRUE, sim_next_event(now)); //woken early by CARME_CAN_Write
+    }
+}
+
+/**
+ * @brief       Initializes the cell and starts the bus task
+ * @type        global
+ * @return      None
+ **/
+void sim_cell_init(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &real_start);
+
+    for(belt_id_t belt = 0; belt < topology_belt_count; belt++) {
+        belts[belt].stop_pos = BELT_END_POS;
+    }
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        memcpy(arms[arm].from, topology_arms[arm].waypoints[0], TOPOLOGY_AXES);
+        memcpy(arms[arm].to, topology_arms[arm].waypoints[0], TOPOLOGY_AXES);
+        arms[arm].arrived = true;
+    }
+    operator_next = 500;
+
+    xTaskCreate(sim_bus_task, "Sim Bus", SIM_STACKSIZE, NULL, SIM_PRIORITY, &bus_task);
+}
+
+
+/* ----- CAN driver of the BSP ---------------------------------------------- */
+
+void CARME_CAN_InitI(uint32_t baud, uint8_t flags, uint32_t interrupts)
+{
+}
+
+ERROR_CODES CARME_CAN_SetMode(uint8_t flags)
+{
+    return CARME_NO_ERROR;
+}
+
+ERROR_CODES CARME_CAN_SetAcceptaceFilter(CARME_CAN_ACCEPTANCE_FILTER* af)
+{
+    return CARME_NO_ERROR;
+}
+
+void CARME_CAN_RegisterIRQCallback(enum CARME_CAN_IRQ_CALLBACKS id, IRQ_CALLBACK pfnCallback)
+{
+    if(id < CARME_CAN_IRQID_COUNT) {
+        callbacks[id] = pfnCallback;
+    }
+}
+
+/**
+ * @brief       Puts a frame onto the bus. The addressed station handles it right away,
+ *              its answer and the transmit completion are delivered after \ref SIM_LATENCY.
+ *              Called by ucan within a critical section.
+ * @type        global
+ * @param[in]   txMsg   The frame
+ * @return      CARME_NO_ERROR
+ **/
+ERROR_CODES CARME_CAN_Write(CARME_CAN_MESSAGE* txMsg)
+{
+    faults.frames++;
+    if(sim_random(1000) < sim_config.frame_loss) { //nobody acknowledges: no transmit completion, no answer
+        faults.frames_lost++;
+        return CARME_NO_ERROR;
+    }
+    sim_schedule(true, NULL);
+    xTaskNotifyGive(bus_task);
+
+    for(belt_id_t belt = 0; belt < topology_belt_count; belt++) {
+        const topology_dispatcher_t* dispatcher = topology_belts[belt].dispatcher;
+        if((txMsg->id & 0xFF0) == topology_belts[belt].can_base) {
+            sim_belt_frame(belt, txMsg);
+        } else if(dispatcher != NULL && txMsg->id == dispatcher->can_id) {
+            sim_dispatcher_frame(belt, txMsg);
+        }
+    }
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        if((txMsg->id & 0xFF0) == topology_arms[arm].can_base) {
+            sim_arm_frame(arm, txMsg);
+        }
+    }
+    return CARME_NO_ERROR;
+}
+
+/**
+ * @brief       Reads a frame from the receive fifo
+ * @type        global
+ * @param[out]  rxMsg   Buffer for the frame
+ * @return      CARME_NO_ERROR, or CARME_ERROR_CAN_RXFIFO_EMPTY
+ **/
+ERROR_CODES CARME_CAN_Read(CARME_CAN_MESSAGE* rxMsg)
+{
+    if(fifo_count == 0) {
+        return CARME_ERROR_CAN_RXFIFO_EMPTY;
+    }
+    *rxMsg = fifo[fifo_head];
+    fifo_head = (fifo_head + 1) % SIM_FIFO_SIZE;
+    fifo_count--;
+    return CARME_NO_ERROR;
+}
+
+/*@}*/
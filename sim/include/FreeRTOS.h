@@ -0,0 +1,14 @@
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+/*
+ * The kernel headers of libs/FreeRTOS with the configuration and the port of the simulator.
+ * FreeRTOS.h and portable.h include their configuration and port with quotes, which finds the
+ * files of the target next to them, so the ones of the simulator are included first.
+ */
+
+#include "FreeRTOSConfig.h"
+#include "portmacro.h"
+#include "../../libs/FreeRTOS/FreeRTOS.h"
+
+#endif /* SIM_FREERTOS_H */
@@ -0,0 +1,62 @@
+#ifndef CAN_H
+#define CAN_H
+
+/* Simulator replacement of the CARME CAN driver (SJA1000). Implemented by sim/cell.c */
+
+#include <stdint.h>
+#include "carme.h"
+#include "stm32f4xx.h"
+
+#define CARME_CAN_BAUD_250K                 250000 //!< Baudrade 250K
+#define CARME_CAN_DF_RESET                  0x00 //!< RM-Bit in MOD register set
+#define CARME_CAN_DF_NORMAL                 0x01 //!< RM-Bit in MOD register cleared
+#define CARME_CAN_INT_TX                    0x02 //!< Transmit Interrupt Enable
+#define CARME_CAN_INT_RX                    0x01 //!< Receive Interrupt Enable
+#define CARME_CAN_nCAN_IRQn_CH              EXTI9_5_IRQn //!< Interrupt channel of the chip
+
+#define CARME_ERROR_CAN_RXFIFO_EMPTY        (CARME_ERROR_CAN_BASE + 2) //!< RxFIFO empty
+
+/**
+ * @brief Interrupt sources of the chip
+ */
+enum CARME_CAN_IRQ_CALLBACKS {
+    CARME_CAN_IRQID_RX_INTERRUPT = 0, //!< Telegram received
+    CARME_CAN_IRQID_TX_INTERRUPT, //!< Telegram transmitted
+    CARME_CAN_IRQID_COUNT
+};
+
+/**
+ * @brief A CAN message
+ */
+typedef struct _CARME_CAN_MESSAGE {
+    uint32_t id; //!< Identifier
+    uint8_t ext; //!< Extended frame format
+    uint8_t rtr; //!< RTR bit
+    uint8_t dlc; //!< Number of data bytes
+    uint8_t data[8]; //!< Data bytes
+} CARME_CAN_MESSAGE;
+
+enum CARME_CAN_ACCEPTANCE_FILTER_MODE {
+    MODE_SINGLE = 1, //!< single acceptance filter
+    MODE_DUAL = 0 //!< dual acceptance filter
+};
+
+/**
+ * @brief Acceptance filter (ignored by the simulator)
+ */
+typedef struct _CARME_CAN_ACCEPTANCE_FILTER {
+    uint8_t acr[4]; //!< Acceptance code
+    uint8_t amr[4]; //!< Acceptance mask
+    enum CARME_CAN_ACCEPTANCE_FILTER_MODE afm; //!< Filter mode
+} CARME_CAN_ACCEPTANCE_FILTER;
+
+typedef void (*IRQ_CALLBACK)();
+
+void CARME_CAN_InitI(uint32_t baud, uint8_t flags, uint32_t interrupts);
+void CARME_CAN_RegisterIRQCallback(enum CARME_CAN_IRQ_CALLBACKS id, IRQ_CALLBACK pfnCallback);
+ERROR_CODES CARME_CAN_Write(CARME_CAN_MESSAGE* txMsg);
+ERROR_CODES CARME_CAN_Read(CARME_CAN_MESSAGE* rxMsg);
+ERROR_CODES CARME_CAN_SetMode(uint8_t flags);
+ERROR_CODES CARME_CAN_SetAcceptaceFilter(CARME_CAN_ACCEPTANCE_FILTER* af);
+
+#endif /* CAN_H */
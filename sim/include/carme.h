@@ -0,0 +1,15 @@
+#ifndef CARME_H
+#define CARME_H
+
+/* Simulator replacement of the CARME BSP header: only what ucan.c uses */
+
+#include <stdint.h>
+
+typedef uint8_t ERROR_CODES; //!< Error code of the BSP functions
+
+#define CARME_NO_ERROR          0x0 //!< No error
+#define CARME_ERROR_CAN_BASE    0x50 //!< First error code of the CAN driver
+
+#define min(a, b)   ( ((a) < (b)) ? (a) : (b) )
+
+#endif /* CARME_H */
@@ -0,0 +1,11 @@
+#ifndef CARME_IO1_H
+#define CARME_IO1_H
+
+/* Simulator replacement of the CARME IO1 driver. The switches are set on the command line (-w), the buttons are never pressed */
+
+#include <stdint.h>
+
+void CARME_IO1_SWITCH_Get(uint8_t *pStatus);
+void CARME_IO1_BUTTON_Get(uint8_t *pStatus);
+
+#endif /* CARME_IO1_H */
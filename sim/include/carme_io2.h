@@ -0,0 +1,16 @@
+#ifndef CARME_IO2_H
+#define CARME_IO2_H
+
+/* Simulator replacement of the CARME IO2 driver. Only the ADC is used (the poti, which always reads 0) */
+
+#include <stdint.h>
+
+typedef enum _CARME_IO2_ADC_CHANNEL {
+    CARME_IO2_ADC_PORT0 = 0,
+    CARME_IO2_ADC_PORT1 = 1,
+    CARME_IO2_ADC_PORT2 = 2
+} CARME_IO2_ADC_CHANNEL;
+
+void CARME_IO2_ADC_Get(CARME_IO2_ADC_CHANNEL channel, uint16_t *pValue);
+
+#endif /* CARME_IO2_H */
@@ -0,0 +1,6 @@
+#ifndef MEMPOOLSERVICE_H_
+#define MEMPOOLSERVICE_H_
+
+/* Included by arm.c, the memory pools are not used by the cell */
+
+#endif /* MEMPOOLSERVICE_H_ */
@@ -0,0 +1,51 @@
+#ifndef PORTMACRO_H
+#define PORTMACRO_H
+
+/*
+ * Port of the simulator: the types of the Cortex-M4 port (libs/FreeRTOS/portmacro.h) and
+ * the scheduler calls of the host kernel (sim/kernel.c). There are no interrupts to mask,
+ * the critical sections only defer the preemption.
+ */
+
+#include <stdint.h>
+
+#define portCHAR        char
+#define portFLOAT       float
+#define portDOUBLE      double
+#define portLONG        long
+#define portSHORT       short
+#define portSTACK_TYPE  uint32_t
+#define portBASE_TYPE   long
+
+typedef portSTACK_TYPE StackType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define portMAX_DELAY               ( TickType_t ) 0xffffffffUL
+#define portTICK_TYPE_IS_ATOMIC     1
+#define portSTACK_GROWTH            ( -1 )
+#define portTICK_PERIOD_MS          ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portBYTE_ALIGNMENT          8
+
+void vPortYield(void);
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+
+#define portYIELD()                                 vPortYield()
+#define portEND_SWITCHING_ISR( xSwitchRequired )    if( xSwitchRequired != pdFALSE ) portYIELD()
+#define portYIELD_FROM_ISR( x )                     portEND_SWITCHING_ISR( x )
+
+#define portSET_INTERRUPT_MASK_FROM_ISR()           0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)        ( void ) ( x )
+#define portDISABLE_INTERRUPTS()
+#define portENABLE_INTERRUPTS()
+#define portENTER_CRITICAL()                        vPortEnterCritical()
+#define portEXIT_CRITICAL()                         vPortExitCritical()
+
+#define portTASK_FUNCTION_PROTO( vFunction, pvParameters ) void vFunction( void *pvParameters )
+#define portTASK_FUNCTION( vFunction, pvParameters ) void vFunction( void *pvParameters )
+
+#define portNOP()
+
+#endif /* PORTMACRO_H */
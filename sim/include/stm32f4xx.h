@@ -0,0 +1,31 @@
+#ifndef STM32F4XX_H
+#define STM32F4XX_H
+
+/* Simulator replacement of the CMSIS device header: the GPIO and NVIC setup of ucan.c does nothing */
+
+#include <stdint.h>
+
+typedef enum {EXTI9_5_IRQn = 23} IRQn_Type;
+
+typedef struct {
+    uint32_t GPIO_Pin;
+    uint32_t GPIO_Mode;
+    uint32_t GPIO_Speed;
+    uint32_t GPIO_OType;
+    uint32_t GPIO_PuPd;
+} GPIO_InitTypeDef;
+
+#define GPIOA                   ((void*)0)
+#define GPIO_Pin_0              0x0001
+#define GPIO_Mode_OUT           0x01
+#define GPIO_OType_PP           0x00
+#define GPIO_Speed_2MHz         0x00
+#define GPIO_PuPd_NOPULL        0x00
+#define RCC_AHB1Periph_GPIOA    0x00000001
+#define ENABLE                  1
+
+#define RCC_AHB1PeriphClockCmd(periph, state)   ((void)(periph), (void)(state))
+#define GPIO_Init(port, init)                   ((void)(port), (void)(init))
+#define NVIC_SetPriority(irq, priority)         ((void)(irq), (void)(priority))
+
+#endif /* STM32F4XX_H */
@@ -0,0 +1,1020 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup sim_kernel Simulated kernel
+ * @brief The FreeRTOS V9 API of libs/FreeRTOS on the host, in virtual time
+ *
+ * Every task runs in a thread, but only one at a time: the scheduler hands the processor to the ready task
+ * with the highest priority (the longest ready one within a priority), which keeps it until it blocks, yields
+ * or readies a task with a higher priority. Running code takes no time. When all tasks are blocked, the tick
+ * count jumps to the next timeout, so the duration of a run only depends on the number of events, not on the
+ * simulated time. If all tasks are blocked without a timeout, the tasks are printed and the run ends.
+ *
+ * Implemented is the part of the API the firmware uses: tasks, delays, queues and semaphores (without priority
+ * inheritance), event groups and task notifications. The interrupts are the callbacks called by the bus task
+ * of cell.c, the FromISR functions work like the task functions. A critical section defers the preemption.
+ */
+/*@{*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+#include <event_groups.h>
+#include "sim.h"
+
+// -------------------- Configuration  ------------
+#define SIM_THREAD_STACK    (256 * 1024) //!< Stack of each task thread in bytes, independent of the stack depth of the firmware
+
+
+// ------------------ Implementation ------------------------
+
+/**
+ * @brief States of a task
+ */
+enum sim_task_state {sim_task_ready, //!< ready or running
+                     sim_task_blocked, //!< waiting on an object, a notification or a delay
+                     sim_task_suspended, //!< suspended until vTaskResume
+                     sim_task_deleted //!< deleted, the thread waits forever
+                    };
+
+/**
+ * @brief States of the notification of a task (as in tasks.c)
+ */
+enum sim_notify_state {sim_notify_none, sim_notify_waiting, sim_notify_received};
+
+/**
+ * @brief A task
+ */
+typedef struct sim_task {
+    pthread_t thread; //!< Thread of the task
+    pthread_cond_t turn; //!< Signaled when the task gets the processor
+    TaskFunction_t code; //!< Task function
+    void* parameters; //!< Parameter of the task function
+    char name[configMAX_TASK_NAME_LEN]; //!< Name of the task
+    UBaseType_t priority; //!< Priority
+    enum sim_task_state state; //!< State
+    uint64_t order; //!< Order within the ready tasks of the same priority
+    const void* object; //!< What a blocked task waits on (for the wake-up and the report)
+    const char* reason; //!< Description of the object, for the report
+    bool timed; //!< The blocked task wakes up at wake
+    TickType_t wake; //!< Timeout of a blocked task
+    bool timed_out; //!< The task woke up by its timeout
+    EventBits_t wait_bits; //!< Bits a task waits on in an event group
+    bool wait_all; //!< All bits have to be set
+    bool wait_clear; //!< The bits are cleared when the wait ends
+    EventBits_t result_bits; //!< Bits of the event group when the wait ended
+    uint32_t notify_value; //!< Notification value
+    enum sim_notify_state notify_state; //!< Notification state
+    struct sim_task* next; //!< Next task in the list of all tasks
+} sim_task_t;
+
+/**
+ * @brief A queue or semaphore (item size 0)
+ */
+typedef struct {
+    uint8_t* storage; //!< Items
+    UBaseType_t length; //!< Max number of items
+    UBaseType_t item_size; //!< Size of an item
+    UBaseType_t count; //!< Number of items
+    UBaseType_t head; //!< Index of the first item
+    uint8_t receivers; //!< Address the receiving tasks wait on
+    uint8_t senders; //!< Address the sending tasks wait on
+} sim_queue_t;
+
+/**
+ * @brief An event group
+ */
+typedef struct {
+    EventBits_t bits; //!< Current bits
+} sim_event_group_t;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER; //!< Held by the running task while it is in the kernel
+static sim_task_t* sim_tasks; //!< All tasks
+static sim_task_t* sim_current; //!< The running task, NULL before the start
+static volatile TickType_t sim_tick; //!< Tick count
+static uint64_t sim_order; //!< Next order of a ready task
+static UBaseType_t sim_nesting; //!< Nesting of critical sections and scheduler suspensions
+static bool sim_yield_pending; //!< A preemption was deferred by a critical section
+
+
+/**
+ * @brief       Makes a task ready, behind the ready tasks of its priority
+ * @type        static
+ * @param[in]   task    The task
+ * @return      None
+ **/
+static void sim_ready(sim_task_t* task)
+{
+    task->state = sim_task_ready;
+    task->object = NULL;
+    task->order = sim_order++;
+}
+
+/**
+ * @brief       Returns the task which gets the processor
+ * @type        static
+ * @return      The ready task with the highest priority, NULL if all tasks are blocked
+ **/
+static sim_task_t* sim_select(void)
+{
+    sim_task_t* best = NULL;
+
+    for(sim_task_t* task = sim_tasks; task != NULL; task = task->next) {
+        if(task->state == sim_task_ready && (best == NULL || task->priority > best->priority ||
+                                             (task->priority == best->priority && task->order < best->order))) {
+            best = task;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief       Prints all tasks which are not ready
+ * @type        global
+ * @return      None
+ **/
+void sim_print_tasks(void)
+{
+    for(sim_task_t* task = sim_tasks; task != NULL; task = task->next) {
+        if(task->state == sim_task_blocked && !task->timed) {
+            printf("  %-20s blocked on %s\n", task->name, task->reason);
+        } else if(task->state == sim_task_suspended) {
+            printf("  %-20s suspended\n", task->name);
+        }
+    }
+}
+
+/**
+ * @brief       Advances the tick count to the next timeout and readies the tasks which time out.
+ *              Ends the run if no task has a timeout.
+ * @type        static
+ * @return      None
+ **/
+static void sim_advance(void)
+{
+    bool found = false;
+    TickType_t delta = 0;
+
+    for(sim_task_t* task = sim_tasks; task != NULL; task = task->next) {
+        if(task->state == sim_task_blocked && task->timed) {
+            TickType_t remaining = (int32_t)(task->wake - sim_tick) > 0 ? task->wake - sim_tick : 0;
+            if(!found || remaining < delta) {
+                delta = remaining;
+                found = true;
+            }
+        }
+    }
+    if(!found) {
+        printf("\nDeadlock at %lu.%03lu s, all tasks wait without a timeout:\n", (unsigned long)sim_tick / 1000,
+               (unsigned long)sim_tick % 1000);
+        sim_print_tasks();
+        fflush(stdout);
+        exit(EXIT_FAILURE);
+    }
+
+    sim_tick += delta;
+    for(sim_task_t* task = sim_tasks; task != NULL; task = task->next) {
+        if(task->state == sim_task_blocked && task->timed && (int32_t)(task->wake - sim_tick) <= 0) {
+            sim_ready(task);
+            task->timed_out = true;
+        }
+    }
+}
+
+/**
+ * @brief       Hands the processor to the selected task and returns when the calling task gets it back.
+ *              The caller holds the lock and has changed its state (blocked, yielded ...).
+ * @type        static
+ * @return      None
+ **/
+static void sim_dispatch(void)
+{
+    sim_task_t* self = sim_current;
+    sim_task_t* next;
+
+    while((next = sim_select()) == NULL) {
+        sim_advance();
+    }
+    if(next != self) {
+        sim_current = next;
+        pthread_cond_signal(&next->turn);
+        while(sim_current != self) {
+            pthread_cond_wait(&self->turn, &sim_lock);
+        }
+    }
+}
+
+/**
+ * @brief       Gives the processor to a ready task with a higher priority, if there is one.
+ *              Within a critical section the preemption is deferred to its end.
+ * @type        static
+ * @return      None
+ **/
+static void sim_preempt(void)
+{
+    if(sim_current == NULL) {
+        return;
+    }
+    sim_task_t* next = sim_select();
+    if(next == NULL || next->priority <= sim_current->priority) {
+        return;
+    }
+    if(sim_nesting > 0) {
+        sim_yield_pending = true;
+        return;
+    }
+    sim_dispatch();
+}
+
+/**
+ * @brief       Returns whether a task readied by an interrupt has a higher priority than the running task
+ * @type        static
+ * @param[in]   task    The readied task
+ * @param[out]  woken   Set to pdTRUE if the running task has to yield (may be NULL)
+ * @return      None
+ **/
+static void sim_woken(const sim_task_t* task, BaseType_t* woken)
+{
+    if(woken != NULL && sim_current != NULL && task->priority > sim_current->priority) {
+        *woken = pdTRUE;
+    }
+}
+
+/**
+ * @brief       Blocks the running task until it is readied or the timeout expires
+ * @type        static
+ * @param[in]   object  What the task waits on
+ * @param[in]   reason  Description of the object, for the report
+ * @param[in]   timeout Max time in ticks, portMAX_DELAY to wait forever
+ * @return      false if the timeout expired
+ **/
+static bool sim_block(const void* object, const char* reason, TickType_t timeout)
+{
+    sim_task_t* self = sim_current;
+
+    configASSERT(self != NULL && sim_nesting == 0);
+    self->state = sim_task_blocked;
+    self->object = object;
+    self->reason = reason;
+    self->timed = timeout != portMAX_DELAY;
+    self->wake = sim_tick + timeout;
+    self->timed_out = false;
+    sim_dispatch();
+    return !self->timed_out;
+}
+
+/**
+ * @brief       Returns the remaining time of a wait which started with a timeout
+ * @type        static
+ * @param[in]   timeout     Timeout of the wait, portMAX_DELAY to wait forever
+ * @param[in]   start       Tick count at the start of the wait
+ * @return      Remaining ticks, 0 if the timeout expired
+ **/
+static TickType_t sim_remaining(TickType_t timeout, TickType_t start)
+{
+    if(timeout == portMAX_DELAY) {
+        return portMAX_DELAY;
+    }
+    TickType_t elapsed = sim_tick - start;
+    return elapsed < timeout ? timeout - elapsed : 0;
+}
+
+/**
+ * @brief       Readies the task which waits the longest on an object, among the ones with the highest priority
+ * @type        static
+ * @param[in]   object  The object
+ * @return      The readied task, NULL if no task waits
+ **/
+static sim_task_t* sim_wake_one(const void* object)
+{
+    sim_task_t* best = NULL;
+
+    for(sim_task_t* task = sim_tasks; task != NULL; task = task->next) {
+        if(task->state == sim_task_blocked && task->object == object &&
+                (best == NULL || task->priority > best->priority ||
+                 (task->priority == best->priority && task->order < best->order))) {
+            best = task;
+        }
+    }
+    if(best != NULL) {
+        sim_ready(best);
+    }
+    return best;
+}
+
+/**
+ * @brief       Start routine of a task thread: waits until the task gets the processor the first time
+ * @type        static
+ * @param[in]   arg     The task
+ * @return      Never returns
+ **/
+static void* sim_thread(void* arg)
+{
+    sim_task_t* self = arg;
+
+    pthread_mutex_lock(&sim_lock);
+    while(sim_current != self) {
+        pthread_cond_wait(&self->turn, &sim_lock);
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    self->code(self->parameters);
+    vTaskDelete(NULL); //a task function must not return
+    return NULL;
+}
+
+
+/* ----- Tasks ---------------------------------------------------------------- */
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth,
+                       void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask)
+{
+    sim_task_t* task = calloc(1, sizeof(sim_task_t));
+    pthread_attr_t attr;
+
+    if(task == NULL) {
+        return errCOULD_NOT_ALLOCATE_REQUIRED_MEMORY;
+    }
+    pthread_cond_init(&task->turn, NULL);
+    task->code = pxTaskCode;
+    task->parameters = pvParameters;
+    strncpy(task->name, pcName, configMAX_TASK_NAME_LEN - 1);
+    task->priority = uxPriority < configMAX_PRIORITIES ? uxPriority : configMAX_PRIORITIES - 1;
+
+    pthread_mutex_lock(&sim_lock);
+    sim_ready(task);
+    sim_task_t** tail = &sim_tasks;
+    while(*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = task;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SIM_THREAD_STACK);
+    pthread_create(&task->thread, &attr, sim_thread, task);
+    pthread_attr_destroy(&attr);
+
+    if(pxCreatedTask != NULL) {
+        *pxCreatedTask = task;
+    }
+    sim_preempt();
+    pthread_mutex_unlock(&sim_lock);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    sim_task_t* task = xTaskToDelete != NULL ? xTaskToDelete : sim_current;
+
+    pthread_mutex_lock(&sim_lock);
+    task->state = sim_task_deleted;
+    if(task == sim_current) {
+        sim_dispatch(); //never returns to a deleted task
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    if(xTicksToDelay == 0) {
+        taskYIELD();
+        return;
+    }
+    pthread_mutex_lock(&sim_lock);
+    sim_block(NULL, "delay", xTicksToDelay);
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void vTaskDelayUntil(TickType_t * const pxPreviousWakeTime, const TickType_t xTimeIncrement)
+{
+    pthread_mutex_lock(&sim_lock);
+    TickType_t wake = *pxPreviousWakeTime + xTimeIncrement;
+    *pxPreviousWakeTime = wake;
+    if((int32_t)(wake - sim_tick) > 0) {
+        sim_block(NULL, "delay", wake - sim_tick);
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return sim_tick;
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return sim_tick;
+}
+
+char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    sim_task_t* task = xTaskToQuery != NULL ? xTaskToQuery : sim_current;
+    return task != NULL ? task->name : "main";
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return sim_current;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask)
+{
+    sim_task_t* task = xTask != NULL ? xTask : sim_current;
+    return task->priority;
+}
+
+void vTaskPrioritySet(TaskHandle_t xTask, UBaseType_t uxNewPriority)
+{
+    sim_task_t* task = xTask != NULL ? xTask : sim_current;
+
+    pthread_mutex_lock(&sim_lock);
+    task->priority = uxNewPriority < configMAX_PRIORITIES ? uxNewPriority : configMAX_PRIORITIES - 1;
+    if(task == sim_current) {
+        sim_task_t* next = sim_select();
+        if(next != NULL && next != task && next->priority > task->priority) {
+            sim_dispatch();
+        }
+    } else {
+        sim_preempt();
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void vTaskSuspend(TaskHandle_t xTaskToSuspend)
+{
+    sim_task_t* task = xTaskToSuspend != NULL ? xTaskToSuspend : sim_current;
+
+    pthread_mutex_lock(&sim_lock);
+    task->state = sim_task_suspended; //a blocked task times out when it is resumed
+    task->object = NULL;
+    task->timed_out = true;
+    task->notify_state = sim_notify_none;
+    if(task == sim_current) {
+        sim_dispatch();
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void vTaskResume(TaskHandle_t xTaskToResume)
+{
+    sim_task_t* task = xTaskToResume;
+
+    pthread_mutex_lock(&sim_lock);
+    if(task != NULL && task->state == sim_task_suspended) {
+        sim_ready(task);
+        sim_preempt();
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void vTaskSuspendAll(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    sim_nesting++;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+    BaseType_t yielded = pdFALSE;
+
+    pthread_mutex_lock(&sim_lock);
+    if(sim_nesting > 0 && --sim_nesting == 0 && sim_yield_pending) {
+        sim_yield_pending = false;
+        sim_preempt();
+        yielded = pdTRUE;
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return yielded;
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+    return sim_current != NULL ? taskSCHEDULER_RUNNING : taskSCHEDULER_NOT_STARTED;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    return SIM_THREAD_STACK / sizeof(StackType_t); //the host stacks are not measured
+}
+
+void vTaskStartScheduler(void)
+{
+    pthread_cond_t never = PTHREAD_COND_INITIALIZER;
+
+    pthread_mutex_lock(&sim_lock);
+    sim_task_t* first;
+    while((first = sim_select()) == NULL) {
+        sim_advance();
+    }
+    sim_current = first;
+    pthread_cond_signal(&first->turn);
+    while(true) { //the run ends with exit() in a task
+        pthread_cond_wait(&never, &sim_lock);
+    }
+}
+
+void vTaskEndScheduler(void)
+{
+    exit(EXIT_SUCCESS);
+}
+
+void vPortYield(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    if(sim_nesting > 0) {
+        sim_yield_pending = true;
+    } else if(sim_current != NULL) {
+        sim_current->order = sim_order++; //behind the other ready tasks of the same priority
+        sim_dispatch();
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void vPortEnterCritical(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    sim_nesting++;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void vPortExitCritical(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    if(sim_nesting > 0 && --sim_nesting == 0 && sim_yield_pending) {
+        sim_yield_pending = false;
+        sim_preempt();
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void *pvPortMalloc(size_t xSize)
+{
+    return malloc(xSize);
+}
+
+void vPortFree(void *pv)
+{
+    free(pv);
+}
+
+
+/* ----- Task notifications --------------------------------------------------- */
+
+/**
+ * @brief       Notifies a task (see xTaskGenericNotify). The caller holds the lock.
+ * @type        static
+ * @return      pdFAIL if the value was not overwritten (eSetValueWithoutOverwrite), otherwise pdPASS
+ **/
+static BaseType_t sim_notify(sim_task_t* task, uint32_t value, eNotifyAction action, uint32_t* previous, BaseType_t* woken)
+{
+    enum sim_notify_state state = task->notify_state;
+
+    if(previous != NULL) {
+        *previous = task->notify_value;
+    }
+    switch(action) {
+    case eSetBits:
+        task->notify_value |= value;
+        break;
+    case eIncrement:
+        task->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if(state == sim_notify_received) {
+            return pdFAIL;
+        }
+        task->notify_value = value;
+        break;
+    default:
+        break;
+    }
+    task->notify_state = sim_notify_received;
+
+    if(state == sim_notify_waiting && task->state == sim_task_blocked && task->object == &task->notify_value) {
+        sim_ready(task);
+        if(woken != NULL) {
+            sim_woken(task, woken);
+        } else {
+            sim_preempt();
+        }
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction, uint32_t *pulPreviousNotificationValue)
+{
+    pthread_mutex_lock(&sim_lock);
+    BaseType_t result = sim_notify(xTaskToNotify, ulValue, eAction, pulPreviousNotificationValue, NULL);
+    pthread_mutex_unlock(&sim_lock);
+    return result;
+}
+
+BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction,
+                                     uint32_t *pulPreviousNotificationValue, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    BaseType_t woken = pdFALSE;
+
+    pthread_mutex_lock(&sim_lock);
+    BaseType_t result = sim_notify(xTaskToNotify, ulValue, eAction, pulPreviousNotificationValue, &woken);
+    pthread_mutex_unlock(&sim_lock);
+    if(pxHigherPriorityTaskWoken != NULL && woken) {
+        *pxHigherPriorityTaskWoken = pdTRUE;
+    }
+    return result;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    xTaskGenericNotifyFromISR(xTaskToNotify, 0, eIncrement, NULL, pxHigherPriorityTaskWoken);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    pthread_mutex_lock(&sim_lock);
+    sim_task_t* self = sim_current;
+
+    if(self->notify_value == 0 && xTicksToWait > 0) {
+        self->notify_state = sim_notify_waiting;
+        sim_block(&self->notify_value, "notification", xTicksToWait);
+    }
+    uint32_t value = self->notify_value;
+    if(value != 0) {
+        self->notify_value = xClearCountOnExit ? 0 : value - 1;
+    }
+    self->notify_state = sim_notify_none;
+    pthread_mutex_unlock(&sim_lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit, uint32_t *pulNotificationValue, TickType_t xTicksToWait)
+{
+    BaseType_t result = pdTRUE;
+
+    pthread_mutex_lock(&sim_lock);
+    sim_task_t* self = sim_current;
+
+    if(self->notify_state != sim_notify_received) {
+        self->notify_value &= ~ulBitsToClearOnEntry;
+        self->notify_state = sim_notify_waiting;
+        if(xTicksToWait > 0) {
+            sim_block(&self->notify_value, "notification", xTicksToWait);
+        }
+    }
+    if(pulNotificationValue != NULL) {
+        *pulNotificationValue = self->notify_value;
+    }
+    if(self->notify_state != sim_notify_received) {
+        result = pdFALSE;
+    } else {
+        self->notify_value &= ~ulBitsToClearOnExit;
+    }
+    self->notify_state = sim_notify_none;
+    pthread_mutex_unlock(&sim_lock);
+    return result;
+}
+
+
+/* ----- Queues and semaphores ------------------------------------------------ */
+
+QueueHandle_t xQueueGenericCreate(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, const uint8_t ucQueueType)
+{
+    sim_queue_t* queue = calloc(1, sizeof(sim_queue_t));
+
+    if(queue == NULL) {
+        return NULL;
+    }
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    if(uxItemSize > 0) {
+        queue->storage = calloc(uxQueueLength, uxItemSize);
+    }
+    return queue;
+}
+
+QueueHandle_t xQueueCreateMutex(const uint8_t ucQueueType)
+{
+    sim_queue_t* queue = xQueueGenericCreate(1, 0, ucQueueType);
+    if(queue != NULL) {
+        queue->count = 1; //a mutex is created given
+    }
+    return queue;
+}
+
+QueueHandle_t xQueueCreateCountingSemaphore(const UBaseType_t uxMaxCount, const UBaseType_t uxInitialCount)
+{
+    sim_queue_t* queue = xQueueGenericCreate(uxMaxCount, 0, queueQUEUE_TYPE_COUNTING_SEMAPHORE);
+    if(queue != NULL) {
+        queue->count = uxInitialCount;
+    }
+    return queue;
+}
+
+BaseType_t xQueueGenericReset(QueueHandle_t xQueue, BaseType_t xNewQueue)
+{
+    sim_queue_t* queue = xQueue;
+
+    pthread_mutex_lock(&sim_lock);
+    queue->count = 0;
+    queue->head = 0;
+    if(sim_wake_one(&queue->senders) != NULL) {
+        sim_preempt();
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return pdPASS;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    sim_queue_t* queue = xQueue;
+    free(queue->storage);
+    free(queue);
+}
+
+/**
+ * @brief       Puts an item into a queue which has space (or is overwritten) and readies a receiver. The caller holds the lock.
+ * @type        static
+ * @return      The readied receiver, NULL if none was waiting
+ **/
+static sim_task_t* sim_queue_put(sim_queue_t* queue, const void* item, BaseType_t position)
+{
+    if(position == queueOVERWRITE && queue->count == queue->length) {
+        queue->count--;
+    }
+    if(queue->item_size > 0) {
+        UBaseType_t index;
+        if(position == queueSEND_TO_FRONT) {
+            queue->head = (queue->head + queue->length - 1) % queue->length;
+            index = queue->head;
+        } else {
+            index = (queue->head + queue->count) % queue->length;
+        }
+        if(item != NULL) {
+            memcpy(queue->storage + index * queue->item_size, item, queue->item_size);
+        }
+    }
+    queue->count++;
+    return sim_wake_one(&queue->receivers);
+}
+
+/**
+ * @brief       Takes (or peeks) the first item of a queue which is not empty and readies a sender. The caller holds the lock.
+ * @type        static
+ * @return      The readied task, NULL if none
+ **/
+static sim_task_t* sim_queue_get(sim_queue_t* queue, void* buffer, BaseType_t peek)
+{
+    if(queue->item_size > 0 && buffer != NULL) {
+        memcpy(buffer, queue->storage + queue->head * queue->item_size, queue->item_size);
+    }
+    if(peek) {
+        return sim_wake_one(&queue->receivers); //the item is still there for the next receiver
+    }
+    if(queue->item_size > 0) {
+        queue->head = (queue->head + 1) % queue->length;
+    }
+    queue->count--;
+    return sim_wake_one(&queue->senders);
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void * const pvItemToQueue, TickType_t xTicksToWait, const BaseType_t xCopyPosition)
+{
+    sim_queue_t* queue = xQueue;
+
+    pthread_mutex_lock(&sim_lock);
+    TickType_t start = sim_tick;
+    while(queue->count >= queue->length && xCopyPosition != queueOVERWRITE) {
+        TickType_t remaining = sim_remaining(xTicksToWait, start);
+        if(remaining == 0 || !sim_block(&queue->senders, "queue (send)", remaining)) {
+            pthread_mutex_unlock(&sim_lock);
+            return errQUEUE_FULL;
+        }
+    }
+    if(sim_queue_put(queue, pvItemToQueue, xCopyPosition) != NULL) {
+        sim_preempt();
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueGenericSendFromISR(QueueHandle_t xQueue, const void * const pvItemToQueue, BaseType_t * const pxHigherPriorityTaskWoken, const BaseType_t xCopyPosition)
+{
+    sim_queue_t* queue = xQueue;
+    BaseType_t result = errQUEUE_FULL;
+
+    pthread_mutex_lock(&sim_lock);
+    if(queue->count < queue->length || xCopyPosition == queueOVERWRITE) {
+        sim_task_t* task = sim_queue_put(queue, pvItemToQueue, xCopyPosition);
+        if(task != NULL) {
+            sim_woken(task, pxHigherPriorityTaskWoken);
+        }
+        result = pdPASS;
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return result;
+}
+
+BaseType_t xQueueGiveFromISR(QueueHandle_t xQueue, BaseType_t * const pxHigherPriorityTaskWoken)
+{
+    return xQueueGenericSendFromISR(xQueue, NULL, pxHigherPriorityTaskWoken, queueSEND_TO_BACK);
+}
+
+BaseType_t xQueueGenericReceive(QueueHandle_t xQueue, void * const pvBuffer, TickType_t xTicksToWait, const BaseType_t xJustPeek)
+{
+    sim_queue_t* queue = xQueue;
+
+    pthread_mutex_lock(&sim_lock);
+    TickType_t start = sim_tick;
+    while(queue->count == 0) {
+        TickType_t remaining = sim_remaining(xTicksToWait, start);
+        if(remaining == 0 || !sim_block(&queue->receivers, queue->item_size > 0 ? "queue (receive)" : "semaphore", remaining)) {
+            pthread_mutex_unlock(&sim_lock);
+            return pdFALSE;
+        }
+    }
+    if(sim_queue_get(queue, pvBuffer, xJustPeek) != NULL) {
+        sim_preempt();
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t xQueue, void * const pvBuffer, BaseType_t * const pxHigherPriorityTaskWoken)
+{
+    sim_queue_t* queue = xQueue;
+    BaseType_t result = pdFALSE;
+
+    pthread_mutex_lock(&sim_lock);
+    if(queue->count > 0) {
+        sim_task_t* task = sim_queue_get(queue, pvBuffer, pdFALSE);
+        if(task != NULL) {
+            sim_woken(task, pxHigherPriorityTaskWoken);
+        }
+        result = pdTRUE;
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return result;
+}
+
+UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t xQueue)
+{
+    return ((const sim_queue_t*)xQueue)->count;
+}
+
+UBaseType_t uxQueueMessagesWaitingFromISR(const QueueHandle_t xQueue)
+{
+    return ((const sim_queue_t*)xQueue)->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(const QueueHandle_t xQueue)
+{
+    const sim_queue_t* queue = xQueue;
+    return queue->length - queue->count;
+}
+
+
+/* ----- Event groups --------------------------------------------------------- */
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(sim_event_group_t));
+}
+
+void vEventGroupDelete(EventGroupHandle_t xEventGroup)
+{
+    free(xEventGroup);
+}
+
+/**
+ * @brief       Returns whether the bits a task waits on are set
+ * @type        static
+ **/
+static bool sim_bits_match(EventBits_t bits, EventBits_t wanted, bool all)
+{
+    return all ? (bits & wanted) == wanted : (bits & wanted) != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor, const BaseType_t xClearOnExit,
+                                const BaseType_t xWaitForAllBits, TickType_t xTicksToWait)
+{
+    sim_event_group_t* group = xEventGroup;
+    EventBits_t result;
+
+    pthread_mutex_lock(&sim_lock);
+    sim_task_t* self = sim_current;
+    result = group->bits;
+    if(sim_bits_match(group->bits, uxBitsToWaitFor, xWaitForAllBits)) {
+        if(xClearOnExit) {
+            group->bits &= ~uxBitsToWaitFor;
+        }
+    } else if(xTicksToWait > 0) {
+        self->wait_bits = uxBitsToWaitFor;
+        self->wait_all = xWaitForAllBits;
+        self->wait_clear = xClearOnExit;
+        if(sim_block(group, "event group", xTicksToWait)) {
+            result = self->result_bits; //the bits were cleared by the setter
+        } else {
+            result = group->bits;
+        }
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return result;
+}
+
+/**
+ * @brief       Sets bits of an event group and readies all tasks whose condition is met (see xEventGroupSetBits). The caller holds the lock.
+ * @type        static
+ * @param[out]  woken   Set to pdTRUE if a readied task has a higher priority than the running one (NULL: preempt)
+ * @return      The bits after the waiting tasks were readied
+ **/
+static EventBits_t sim_set_bits(sim_event_group_t* group, EventBits_t bits, BaseType_t* woken)
+{
+    EventBits_t clear = 0;
+    bool readied = false;
+
+    group->bits |= bits;
+    for(sim_task_t* task = sim_tasks; task != NULL; task = task->next) {
+        if(task->state == sim_task_blocked && task->object == group && sim_bits_match(group->bits, task->wait_bits, task->wait_all)) {
+            task->result_bits = group->bits;
+            if(task->wait_clear) {
+                clear |= task->wait_bits;
+            }
+            sim_ready(task);
+            if(woken != NULL) {
+                sim_woken(task, woken);
+            }
+            readied = true;
+        }
+    }
+    group->bits &= ~clear;
+
+    EventBits_t result = group->bits;
+    if(readied && woken == NULL) {
+        sim_preempt();
+    }
+    return result;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet)
+{
+    pthread_mutex_lock(&sim_lock);
+    EventBits_t result = sim_set_bits(xEventGroup, uxBitsToSet, NULL);
+    pthread_mutex_unlock(&sim_lock);
+    return result;
+}
+
+BaseType_t xEventGroupSetBitsFromISR(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    BaseType_t woken = pdFALSE;
+
+    pthread_mutex_lock(&sim_lock);
+    sim_set_bits(xEventGroup, uxBitsToSet, &woken);
+    pthread_mutex_unlock(&sim_lock);
+    if(pxHigherPriorityTaskWoken != NULL && woken) {
+        *pxHigherPriorityTaskWoken = pdTRUE;
+    }
+    return pdPASS;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear)
+{
+    sim_event_group_t* group = xEventGroup;
+
+    pthread_mutex_lock(&sim_lock);
+    EventBits_t previous = group->bits;
+    group->bits &= ~uxBitsToClear;
+    pthread_mutex_unlock(&sim_lock);
+    return previous;
+}
+
+EventBits_t xEventGroupGetBitsFromISR(EventGroupHandle_t xEventGroup)
+{
+    return ((sim_event_group_t*)xEventGroup)->bits;
+}
+
+/*@}*/
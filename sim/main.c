@@ -0,0 +1,212 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup sim Simulator
+ * @brief Runs the bcs, arm, ucan, metrics and loglevel modules on the host against a model of the cell
+ *
+ * The firmware tasks run unchanged on the kernel of kernel.c, which implements the FreeRTOS V9 API of
+ * libs/FreeRTOS on the host. The CAN driver is replaced by the model in cell.c, the display, dashboard
+ * and telemetry by the stubs below. Whenever all tasks are blocked, the tick count jumps to the next
+ * timeout, so an hour of the cell takes a few seconds.
+ *
+ * Usage: ubor_sim [-t seconds] [-s seed] [-w switches] [-j jitter %] [-l block loss per mille] [-c frame loss per mille] [-v]
+ */
+/*@{*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <carme_io1.h>
+#include <carme_io2.h>
+
+#include "ucan.h"
+#include "loglevel.h"
+#include "metrics.h"
+#include "dashboard.h"
+#include "telemetry.h"
+#include "bcs.h"
+#include "arm.h"
+#include "teach.h"
+#include "sim.h"
+
+// -------------------- Configuration  ------------
+#ifndef MAX_BLOCK_COUNT
+#define MAX_BLOCK_COUNT     4 //!< Blocks in the cell, passed to bcs.c as well (BLOCKS in the Makefile)
+#endif
+
+sim_config_t sim_config = {
+    .duration = 3600000,
+    .seed = 1,
+    .blocks = MAX_BLOCK_COUNT,
+    .switches = 0,
+    .jitter = 10,
+    .block_loss = 0,
+    .frame_loss = 0,
+    .belt_speed = 60,
+    .arm_speed = 40,
+    .gripper_time = 300,
+    .dispatcher_time = 800,
+    .verbose = false,
+};
+
+
+// ------------------ Implementation ------------------------
+
+/**
+ * @brief       Prints a log message of the firmware with the virtual time and the task name
+ * @type        global
+ * @param[in]   id      Id of the message to overwrite (ignored, every message is printed)
+ * @param[in]   fmtstr  printf format
+ * @return      The id of the message
+ **/
+uint8_t display_log(uint8_t id, const char* fmtstr, ...)
+{
+    static uint8_t next_id = 1;
+    TickType_t now = xTaskGetTickCount();
+    va_list args;
+
+    if(sim_config.verbose) {
+        printf("%6lu.%03lu %-12s ", (unsigned long)now / 1000, (unsigned long)now % 1000, pcTaskGetName(NULL));
+        va_start(args, fmtstr);
+        vprintf(fmtstr, args);
+        va_end(args);
+        printf("\n");
+    }
+    if(id == DISPLAY_NEWLINE) {
+        id = next_id++;
+        next_id = next_id == 0 ? 1 : next_id;
+    }
+    return id;
+}
+
+/* ----- The dashboard is not shown ------------------------------------------ */
+void dashboard_belt_update(belt_id_t belt, enum dashboard_belt_state state, uint16_t position) {}
+void dashboard_dispatcher_update(int8_t direction) {}
+void dashboard_arm_update(arm_id_t arm, uint8_t waypoint) {}
+void dashboard_airspace_update(int8_t owner) {}
+void dashboard_count_block(arm_id_t arm) {}
+
+/* ----- The telemetry frames are dropped ------------------------------------ */
+bool telemetry_send(enum telemetry_type type, const uint8_t* payload, uint8_t length)
+{
+    return true;
+}
+
+/* ----- There is no EEPROM, the compiled-in waypoints are used -------------- */
+bool teach_capture(arm_id_t arm, uint8_t waypoint, const uint8_t* position)
+{
+    return false;
+}
+
+bool teach_save()
+{
+    return false;
+}
+
+void teach_get_waypoint(arm_id_t arm, uint8_t waypoint, uint8_t* position)
+{
+    memcpy(position, topology_arms[arm].waypoints[waypoint], TOPOLOGY_AXES);
+}
+
+bool teach_is_taught(arm_id_t arm, uint8_t waypoint)
+{
+    return false;
+}
+
+bool teach_load(uint16_t address, uint32_t* record, uint16_t words)
+{
+    return false;
+}
+
+bool teach_store(uint16_t address, uint32_t* record, uint16_t words)
+{
+    return true;
+}
+
+/* ----- Switches, buttons and poti ------------------------------------------ */
+void CARME_IO1_SWITCH_Get(uint8_t *pStatus)
+{
+    *pStatus = sim_config.switches;
+}
+
+void CARME_IO1_BUTTON_Get(uint8_t *pStatus)
+{
+    *pStatus = 0;
+}
+
+void CARME_IO2_ADC_Get(CARME_IO2_ADC_CHANNEL channel, uint16_t *pValue)
+{
+    *pValue = 0;
+}
+
+/**
+ * @brief       Parses the command line, initializes the firmware modules and the cell and starts the scheduler
+ * @return      EXIT_FAILURE on invalid arguments, otherwise the process ends in the bus task
+ **/
+int main(int argc, char** argv)
+{
+    int opt;
+
+    while((opt = getopt(argc, argv, "t:s:w:j:l:c:vh")) != -1) {
+        switch(opt) {
+        case 't':
+            sim_config.duration = strtoul(optarg, NULL, 0) * 1000;
+            break;
+        case 's':
+            sim_config.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            sim_config.switches = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            sim_config.jitter = strtoul(optarg, NULL, 0) % 100;
+            break;
+        case 'l':
+            sim_config.block_loss = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            sim_config.frame_loss = strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            sim_config.verbose = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-t seconds] [-s seed] [-w switches] [-j jitter %%] [-l block loss per mille] [-c frame loss per mille] [-v]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    srand(sim_config.seed);
+
+    sim_cell_init();
+    ucan_init();
+    loglevel_init();
+    metrics_init();
+    bcs_init();
+    init_arm();
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
+
+/*@}*/
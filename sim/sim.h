@@ -0,0 +1,34 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Parameters of a simulation run, set on the command line (see main.c)
+ */
+typedef struct {
+    uint32_t duration; //!< Virtual run time in ticks
+    uint32_t seed; //!< Seed of the random generator
+    uint8_t blocks; //!< Number of blocks the operator places onto the feeder belt
+    uint8_t switches; //!< DIP switches (dispatcher policy, log level)
+    uint8_t jitter; //!< Variation of all motion times in percent (+-)
+    uint16_t block_loss; //!< Probability in per mille that a dropped block falls off the belt
+    uint16_t frame_loss; //!< Probability in per mille that a frame is not acknowledged (and not received)
+    uint16_t belt_speed; //!< Speed of the belts in position units per second
+    uint16_t arm_speed; //!< Speed of the arm joints in units per second
+    uint16_t gripper_time; //!< Time in ticks to open or close a gripper
+    uint16_t dispatcher_time; //!< Time in ticks for a move of a dispatcher
+    bool verbose; //!< Print the log of the firmware
+} sim_config_t;
+
+extern sim_config_t sim_config; //!< Parameters of the run, see main.c
+
+//doc see cell.c
+void sim_cell_init(void);
+uint32_t sim_random(uint32_t range);
+
+//doc see kernel.c
+void sim_print_tasks(void);
+
+#endif /* SIM_H */
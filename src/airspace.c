@@ -0,0 +1,254 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup airspace Airspace
+ * @brief Reservation of the zones of the airspace above a belt which is the target of several arms
+ *
+ * The airspace above a target belt is divided into zones (\ref TOPOLOGY_ZONE_BELT ...), the topology
+ * lists the zones each waypoint of an arm occupies. Before an arm moves to a waypoint it acquires the
+ * zones of that waypoint, when it arrived it keeps only those and releases the others. Arms with the
+ * same target hold different zones at the same time, e.g. one arm retreats above its half of the belt
+ * while the other one descends to drop its block.
+ *
+ * An arm books the zones of its next waypoint ahead. The bookings are granted in order, so an arm
+ * which is about to enter is not overtaken by an arm that comes around again. As long as
+ * \ref AIRSPACE_EXCLUSIVE is 1, every request covers all zones (the former mutex over the whole airspace).
+ * Build with -DAIRSPACE_EXCLUSIVE=0 to use the zones and compare the time the arms wait (\ref airspace_get_wait).
+ */
+/*@{*/
+
+#include "airspace.h"
+#include "loglevel.h"
+#include <task.h>
+#include <event_groups.h>
+
+// -------------------- Configuration  ------------
+#define AIRSPACE_ALL          0xFF //!< All zones, requested by every arm in exclusive mode
+
+#ifndef AIRSPACE_EXCLUSIVE
+#define AIRSPACE_EXCLUSIVE    1 //!< 1: lock the whole airspace, until the zones of the topology were measured on the cell. 0: use the zones. Override with -D.
+#endif
+
+
+// ------------------ Implementation ------------------------
+
+/**
+ * @brief Reservations of the airspace above one target belt
+ */
+typedef struct {
+    EventGroupHandle_t events; //!< One bit per arm, set when zones were released
+    uint8_t held[TOPOLOGY_MAX_ARMS]; //!< Zones each arm holds
+    uint8_t booked[TOPOLOGY_MAX_ARMS]; //!< Zones each arm booked ahead
+    uint32_t booking[TOPOLOGY_MAX_ARMS]; //!< Order of the bookings (lower is earlier)
+} airspace_t;
+
+static airspace_t airspaces[TOPOLOGY_MAX_BELTS]; //!< Airspace above each belt which is the target of an arm
+static uint32_t airspace_bookings; //!< Number of bookings so far, gives the order of the bookings
+static TickType_t airspace_wait[TOPOLOGY_MAX_ARMS]; //!< Ticks each arm waited on the airspace
+
+
+/**
+ * @brief       Returns the zones actually requested
+ * @type        static
+ * @param[in]   zones   Zones of a waypoint
+ * @return      The zones, or all zones in exclusive mode
+ **/
+static uint8_t airspace_request(uint8_t zones)
+{
+#if AIRSPACE_EXCLUSIVE
+    return zones != 0 ? AIRSPACE_ALL : 0;
+#else
+    return zones;
+#endif
+}
+
+/**
+ * @brief       Books zones ahead. Must be called in a critical section.
+ * @type        static
+ * @param[in]   space   The airspace
+ * @param[in]   arm     The arm
+ * @param[in]   zones   Zones the arm will acquire next (in addition to the held zones)
+ * @return      None
+ **/
+static void airspace_book_locked(airspace_t* space, arm_id_t arm, uint8_t zones)
+{
+    zones &= ~space->held[arm];
+    if(zones & ~space->booked[arm]) {
+        space->booked[arm] |= zones;
+        space->booking[arm] = airspace_bookings++;
+    }
+}
+
+/**
+ * @brief       Checks whether zones can be granted to an arm: no other arm holds any of them
+ *              and no other arm booked any of them earlier. Must be called in a critical section.
+ * @type        static
+ * @param[in]   space   The airspace
+ * @param[in]   arm     The arm
+ * @param[in]   zones   Zones the arm requests
+ * @return      true if the zones are free for the arm
+ **/
+static bool airspace_is_free(const airspace_t* space, arm_id_t arm, uint8_t zones)
+{
+    for(arm_id_t other = 0; other < topology_arm_count; other++) {
+        if(other == arm) {
+            continue;
+        }
+        if(space->held[other] & zones) {
+            return false;
+        }
+        if((space->booked[other] & zones) && (int32_t)(space->booking[other] - space->booking[arm]) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief       Books zones which the arm will need after its current move, so that arms
+ *              which request them later have to wait. Does not block.
+ * @type        global
+ * @param[in]   target  The belt the arm drops its blocks onto
+ * @param[in]   arm     The arm
+ * @param[in]   zones   Zones of the next waypoint
+ * @return      None
+ **/
+void airspace_book(belt_id_t target, arm_id_t arm, uint8_t zones)
+{
+    airspace_t* space = &airspaces[target];
+
+    taskENTER_CRITICAL();
+    airspace_book_locked(space, arm, airspace_request(zones));
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief       Acquires zones in addition to the held ones. Blocks until they are granted.
+ * @type        global
+ * @param[in]   target  The belt the arm drops its blocks onto
+ * @param[in]   arm     The arm
+ * @param[in]   zones   Zones of the waypoint the arm moves to next
+ * @return      true if the arm had to wait
+ **/
+bool airspace_acquire(belt_id_t target, arm_id_t arm, uint8_t zones)
+{
+    airspace_t* space = &airspaces[target];
+    EventBits_t event = 1 << arm;
+    TickType_t start = xTaskGetTickCount();
+    bool waited = false;
+
+    zones = airspace_request(zones);
+    while(true) {
+        taskENTER_CRITICAL();
+        airspace_book_locked(space, arm, zones);
+        uint8_t missing = zones & ~space->held[arm];
+        if(airspace_is_free(space, arm, missing)) {
+            space->held[arm] |= zones;
+            space->booked[arm] &= ~zones;
+            taskEXIT_CRITICAL();
+            break;
+        }
+        xEventGroupClearBits(space->events, event); //a release after this wakes us up
+        taskEXIT_CRITICAL();
+
+        if(!waited) {
+            LOG(ARM, LOG_DEBUG, DISPLAY_NEWLINE, "%s waits on airspace %s", topology_arms[arm].name, topology_belts[target].name);
+            waited = true;
+        }
+        xEventGroupWaitBits(space->events, event, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+
+    if(waited) {
+        TickType_t ticks = xTaskGetTickCount() - start;
+        taskENTER_CRITICAL();
+        airspace_wait[arm] += ticks;
+        taskEXIT_CRITICAL();
+    }
+    return waited;
+}
+
+/**
+ * @brief       Keeps only the zones of the waypoint the arm arrived at and releases all others
+ * @type        global
+ * @param[in]   target  The belt the arm drops its blocks onto
+ * @param[in]   arm     The arm
+ * @param[in]   zones   Zones of the waypoint the arm arrived at
+ * @return      true if zones were released
+ **/
+bool airspace_hold(belt_id_t target, arm_id_t arm, uint8_t zones)
+{
+    airspace_t* space = &airspaces[target];
+    bool released;
+
+    taskENTER_CRITICAL();
+    zones = airspace_request(zones);
+    released = (space->held[arm] & ~zones) != 0;
+    space->held[arm] &= zones;
+    taskEXIT_CRITICAL();
+
+    if(released) {
+        xEventGroupSetBits(space->events, ~(1 << arm) & ((1 << TOPOLOGY_MAX_ARMS) - 1)); //wake up all other arms
+    }
+    return released;
+}
+
+/**
+ * @brief       Returns an arm which holds zones of the airspace
+ * @type        global
+ * @param[in]   target  The belt
+ * @return      The first arm that holds zones, -1 if the airspace is free
+ **/
+int8_t airspace_owner(belt_id_t target)
+{
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        if(airspaces[target].held[arm] != 0) {
+            return arm;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief       Returns the time an arm waited on the airspace, since the start
+ * @type        global
+ * @param[in]   arm     The arm
+ * @return      The time in ticks
+ **/
+TickType_t airspace_get_wait(arm_id_t arm)
+{
+    return arm < TOPOLOGY_MAX_ARMS ? airspace_wait[arm] : 0;
+}
+
+/**
+ * @brief       Creates the airspace above the target belt of every arm
+ * @type        global
+ * @return      None
+ **/
+void airspace_init()
+{
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        airspace_t* space = &airspaces[topology_arms[arm].target];
+        if(space->events == NULL) {
+            space->events = xEventGroupCreate();
+        }
+    }
+}
+
+/*@}*/
@@ -0,0 +1,17 @@
+#ifndef AIRSPACE_H
+#define AIRSPACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <FreeRTOS.h>
+#include "topology.h"
+
+//doc see airspace.c
+void airspace_book(belt_id_t target, arm_id_t arm, uint8_t zones);
+bool airspace_acquire(belt_id_t target, arm_id_t arm, uint8_t zones);
+bool airspace_hold(belt_id_t target, arm_id_t arm, uint8_t zones);
+int8_t airspace_owner(belt_id_t target);
+TickType_t airspace_get_wait(arm_id_t arm);
+void airspace_init();
+
+#endif /* AIRSPACE_H */
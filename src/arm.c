@@ -25,6 +25,7 @@
 
 //----- Header-Files -----------------------------------------------------------
 #include <stdio.h>
+#include <string.h>
 
 #include <FreeRTOS.h>
 #include <task.h>
@@ -35,10 +36,18 @@
 #include <stdbool.h>
 
 #include <carme_io1.h>
+#include <carme_io2.h>
 
 #include "arm.h"
 #include "ucan.h"
+#include "loglevel.h"
 #include "bcs.h"
+#include "dashboard.h"
+#include "metrics.h"
+#include "teach.h"
+#include "airspace.h"
+#include "motion.h"
+#include "switches.h"
 
 //----- Macros -----------------------------------------------------------------
 #define BUTTON_T0 0x01
@@ -46,30 +55,16 @@
 #define BUTTON_T2 0x04
 #define BUTTON_T3 0x08
 
-// Left
-#define ROBOT_L_STATUS_REQUEST_ID   0x150
-#define ROBOT_L_STATUS_RETURN_ID    0x151
-#define ROBOT_L_COMAND_REQUEST_ID   0x152
-#define ROBOT_L_COMAND_RETURN_ID    0x153
-#define ROBOT_L_RESET_ID            0x15F
+// Id offsets to the can_base of an arm (see topology.c)
+#define ROBOT_STATUS_REQUEST_ID     0x0
+#define ROBOT_STATUS_RETURN_ID      0x1
+#define ROBOT_COMAND_REQUEST_ID     0x2
+#define ROBOT_COMAND_RETURN_ID      0x3
+#define ROBOT_RESET_ID              0xF
 #define COMAND_DLC                  0x006
 #define STATUS_REQEST_DLC           0x002
 
 
-// Right
-#define ROBOT_R_STATUS_REQUEST_ID   0x160
-#define ROBOT_R_STATUS_RETURN_ID    0x161
-#define ROBOT_R_COMAND_REQUEST_ID   0x162
-#define ROBOT_R_COMAND_RETURN_ID    0x163
-#define ROBOT_R_RESET_ID            0x16F
-
-#define MASK_SWITCH_0               0x01
-#define MASK_SWITCH_1               0x02
-#define MASK_SWITCH_2               0x04
-#define MASK_SWITCH_3               0x08
-#define MASK_SWITCH_4               0x10
-
-
 #define BLOCK_TIME_MIDDLE_POS 200000 // block time for mutex midle position
 #define MSG_QUEUE_SIZE 1
 #define ARM_TASK_PRIORITY 2
@@ -77,242 +72,615 @@
 #define TASK_DELAY 100
 #define GRIPPER_MAX 1
 #define GRIPPER_MIN 0
-
-/**
- * @brief The arm_select enum differenciates between the different arms (left/right)
- */
-enum arm_select {arm_left=belt_left, //!< the left arm
-                 arm_right=belt_right//!< the right arm
-                };
+#define ARM_GRASP_WAYPOINTS 2 // waypoints from the grab waypoint on, which use the grasp pose of the block location (approach and grip)
+#define ARM_LOCATIONS (TOPOLOGY_LOCATION_MAX - TOPOLOGY_LOCATION_MIN + 1) // entries of the grasp table
+#define ARM_GRIPPER_AXIS 5 // index of the gripper in a waypoint
+#define ARM_STOP_TOLERANCE 1 // max joint error at a stop point (the gripper acts there)
+#define ARM_BLEND_RADIUS 4 // max joint error at a via-point, at which the next waypoint is sent (0: stop at every waypoint)
+#define ARM_SETTLE_TIME 1000 // time for the gripper to open or close at a stop point
+#define ARM_MS_PER_UNIT 25 // time in ms the slowest joint needs for one unit, to predict the arrival
+#define ARM_POLL_MIN 10 // min time in ticks between two status requests (close to the target)
+#define ARM_POLL_MAX 250 // max time in ticks between two status requests (long moves)
+#define ARM_STATUS_TIMEOUT 50 // time in ticks to wait on a status response before it is requested again
+#define ARM_STATUS_RETRIES 5 // lost responses in a row after which the command is sent again
+#define ARM_MOVE_MARGIN 1000 // time in ticks the arm may need longer than predicted, before the command is sent again
+#define ARM_SEND_TIMEOUT 50 // max time in ticks until a command is transmitted
+#define ARM_SEND_RETRIES 3 // times a command is sent until it is acknowledged
+#define ARM_JOG_PERIOD 20 // time in ticks between two steps of the manual movement
+#define ARM_JOG_READBACK 200 // time in ticks between two position requests of the manual movement
+#define ARM_JOG_SPEED_MIN 2 // jog speed in units per second with the poti at its minimum
+#define ARM_JOG_SPEED_MAX 40 // jog speed in units per second with the poti at its maximum
+#define ARM_JOG_RAMP 500 // time in ms a button is held, after which the jog speed grows by the poti speed
+#define ARM_JOG_GAIN_MAX 4 // max factor of the jog speed while a button is held
+#define ARM_JOG_ADC_MAX 1023 // full scale of the poti (CARME IO2 ADC port 0)
 
 //----- Data types -------------------------------------------------------------
+typedef struct {
+    uint8_t grab; // waypoint at which the arm approaches the block (right before the gripper closes)
+    uint8_t grip; // waypoint at which the gripper closes (the block has to be at the end of the belt)
+    uint8_t lifted; // waypoint after which the block is off the source belt
+    uint8_t release; // waypoint at which the gripper opens (the target belt has to be ready)
+    uint8_t released; // waypoint after which the block lies on the target belt
+} arm_roles_t;
+
+typedef struct {
+    QueueHandle_t queue; // status responses of the arm
+    uint8_t position[TOPOLOGY_AXES]; // last reported position
+    bool position_valid; // whether the arm reported its position since the start
+    arm_roles_t roles; // waypoints at which the arm synchronizes with the belts
+    uint8_t grasp_table[ARM_LOCATIONS][TOPOLOGY_AXES]; // grasp pose per block location
+    SemaphoreHandle_t control; // held by the task which commands the arm: the arm task, or the manual task in manual mode
+    bool taken_over; // the manual task moved the arm, the arm task returns to its last command first
+    uint8_t commanded[TOPOLOGY_AXES]; // last position commanded by the arm task
+} arm_t;
 
 //----- Function prototypes ----------------------------------------------------
-static  void  wait_until_pos(uint8_t *pos, enum arm_select side);
+static  void  arm_send_command(arm_id_t arm, const uint8_t *pos);
+static  void  wait_until_pos(uint8_t *pos, arm_id_t arm, uint8_t tolerance);
+static  void  arm_move(arm_id_t arm, uint8_t *pos, uint8_t tolerance);
+void  manual_arm_movement(void *pvData);
 
 //----- Data -------------------------------------------------------------------
-static QueueHandle_t robot_left_queue;
-static QueueHandle_t robot_right_queue;
-static QueueHandle_t robot_manual_queue;
+static arm_t arms[TOPOLOGY_MAX_ARMS]; // state of each arm, only written by the task which holds its control
 
-static SemaphoreHandle_t arm_mid_air_mutex;
+static const uint8_t status_request[2] = {0x02,0x00};
 
-CARME_CAN_MESSAGE robot_msg_buffer_right;
-CARME_CAN_MESSAGE robot_msg_buffer_left;
+//----- Implementation ---------------------------------------------------------
 
-uint8_t status_request[2] = {0x02,0x00};
+/**
+ * @brief       Controls the airspace above the target belt. Before the arm
+ *              moves to a waypoint it acquires the zones of the waypoint,
+ *              shared by all arms with the same target, and books the zones
+ *              of the following waypoint.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: the arm / n: index of the waypoint the arm moves to
+ *
+ *  @return     true if the arm had to wait on the airspace
+ **/
+static bool arm_enter_air_space(arm_id_t arm, int n)
+{
+    const topology_arm_t* info = &topology_arms[arm];
+    bool waited = false;
 
-//----- Implementation ---------------------------------------------------------
+    if(info->zones[n] != 0) {
+        waited = airspace_acquire(info->target, arm, info->zones[n]);
+        dashboard_airspace_update(airspace_owner(info->target));
+    }
+    airspace_book(info->target, arm, info->zones[(n + 1) % info->waypoint_count]);
+    return waited;
+}
 
 /**
- * @brief       Controls the airspace in the middle position. This position is
- *              protected with a mutex. Before enter the critical area this
- *              function takes the mutex.
+ * @brief       Controls the airspace above the target belt. After the arm
+ *              arrived at a waypoint it releases all zones but those of the
+ *              waypoint.
  *
  *  @type       static
  *
- *  @param[in]  none
+ *  @param[in]  arm: the arm / n: index of the waypoint the arm arrived at
  *
  *  @return     none
  **/
-static void arm_enter_critical_air_space()
+static void arm_leave_air_space(arm_id_t arm, int n)
 {
-    display_log(DISPLAY_NEWLINE, "take semaphore mid");
-    xSemaphoreTake(arm_mid_air_mutex, portMAX_DELAY); //to protect the airspace around mid
+    const topology_arm_t* info = &topology_arms[arm];
+
+    if(airspace_hold(info->target, arm, info->zones[n])) {
+        dashboard_airspace_update(airspace_owner(info->target));
+    }
 }
 
+
 /**
- * @brief       Controls the airspace in the middle position. This position is
- *              protected with a mutex. After exit the critical area this
- *              function give the mutex.
+ * @brief       Checks whether a waypoint is a via-point, which the arm only has to pass.
+ *              All waypoints are via-points, except those where the gripper acts
+ *              and those right before (the arm has to stand still while it grips or releases).
  *
  *  @type       static
  *
- *  @param[in]  none
+ *  @param[in]  info: the arm / n: index of the waypoint
+ *
+ *  @return     true for a via-point
+ **/
+static bool arm_is_via_point(const topology_arm_t* info, int n)
+{
+    uint8_t gripper = info->waypoints[n][ARM_GRIPPER_AXIS];
+    uint8_t previous = info->waypoints[(n + info->waypoint_count - 1) % info->waypoint_count][ARM_GRIPPER_AXIS];
+    uint8_t next = info->waypoints[(n + 1) % info->waypoint_count][ARM_GRIPPER_AXIS];
+
+    return ARM_BLEND_RADIUS > 0 && gripper == previous && gripper == next;
+}
+
+/**
+ * @brief       Finds the waypoints at which the arm synchronizes with the belts
+ *              from the gripper values: the gripper closes once to take the
+ *              block and opens once to drop it. So the waypoint tables can be
+ *              shortened or reordered without changing the code.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: index of the arm in topology_arms
+ *
+ *  @return     false if the gripper does not close and open in a cycle
+ **/
+static bool arm_find_roles(arm_id_t arm)
+{
+    const topology_arm_t* info = &topology_arms[arm];
+    int count = info->waypoint_count;
+    int grip = -1;
+    int release = -1;
+
+    for(int n = 0; n < count; n++) {
+        uint8_t previous = info->waypoints[(n + count - 1) % count][ARM_GRIPPER_AXIS];
+        uint8_t gripper = info->waypoints[n][ARM_GRIPPER_AXIS];
+
+        if(previous == GRIPPER_MAX && gripper == GRIPPER_MIN) {
+            grip = n;
+        } else if(previous == GRIPPER_MIN && gripper == GRIPPER_MAX) {
+            release = n;
+        }
+    }
+    if(grip < 0 || release < 0) {
+        return false;
+    }
+
+    arms[arm].roles.grab = (grip + count - 1) % count;
+    arms[arm].roles.grip = grip;
+    arms[arm].roles.lifted = (grip + 1) % count;
+    arms[arm].roles.release = release;
+    arms[arm].roles.released = (release + 1) % count;
+    return true;
+}
+
+/**
+ * @brief       Fills the grasp table of an arm with a pose for every location.
+ *              Between two calibrated locations each joint is interpolated
+ *              linearly, outside the calibrated range the nearest pose is used.
+ *              Without calibration the grab waypoint is used for all locations.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: index of the arm in topology_arms
+ *
+ *  @return     none
+ **/
+static void arm_build_grasp_table(arm_id_t arm)
+{
+    const topology_arm_t* info = &topology_arms[arm];
+
+    for(int location = TOPOLOGY_LOCATION_MIN; location <= TOPOLOGY_LOCATION_MAX; location++) {
+        uint8_t *pose = arms[arm].grasp_table[location - TOPOLOGY_LOCATION_MIN];
+
+        if(info->grasp_count == 0) {
+            memcpy(pose, info->waypoints[arms[arm].roles.grab], TOPOLOGY_AXES);
+            continue;
+        }
+
+        uint8_t upper = 0; //first calibration at or after the location
+        while(upper < info->grasp_count - 1 && info->grasps[upper].location < location) {
+            upper++;
+        }
+        const topology_grasp_t* b = &info->grasps[upper];
+        const topology_grasp_t* a = upper > 0 ? &info->grasps[upper - 1] : b;
+
+        if(location >= b->location || a == b) {
+            memcpy(pose, b->pose, TOPOLOGY_AXES);
+            continue;
+        }
+        int span = b->location - a->location;
+        int offset = location - a->location;
+        for(int axis = 0; axis < TOPOLOGY_AXES; axis++) {
+            int delta = (int8_t)b->pose[axis] - (int8_t)a->pose[axis]; //the joints are signed, as in arm_distance
+            pose[axis] = (uint8_t)((int8_t)a->pose[axis] + (delta * offset + (delta < 0 ? -span : span) / 2) / span);
+        }
+    }
+}
+
+/**
+ * @brief       Returns the position of a waypoint. The waypoints at which the
+ *              block is gripped are moved to the grasp pose of its location,
+ *              unless they were taught.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: index of the arm / n: index of the waypoint / location: block location reported by the belt
+ *
+ *  @param[out] pos: the position to send to the arm
  *
  *  @return     none
  **/
-static void arm_leave_critical_air_space()
+static void arm_waypoint(arm_id_t arm, int n, int8_t location, uint8_t *pos)
+{
+    const topology_arm_t* info = &topology_arms[arm];
+
+    teach_get_waypoint(arm, n, pos);
+    if((n - arms[arm].roles.grab + info->waypoint_count) % info->waypoint_count >= ARM_GRASP_WAYPOINTS ||
+            teach_is_taught(arm, n)) {
+        return;
+    }
+
+    if(location < TOPOLOGY_LOCATION_MIN) {
+        location = TOPOLOGY_LOCATION_MIN;
+    } else if(location > TOPOLOGY_LOCATION_MAX) {
+        location = TOPOLOGY_LOCATION_MAX;
+    }
+    memcpy(pos, arms[arm].grasp_table[location - TOPOLOGY_LOCATION_MIN], ARM_GRIPPER_AXIS); //the gripper acts as in the waypoint
+}
+
+/**
+ * @brief       Predicts the time the arm needs from the previous waypoint to
+ *              waypoint n, including the stop at a stop point.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: the arm / n: index of the waypoint
+ *
+ *  @return     the time in ticks
+ **/
+static TickType_t arm_move_time(arm_id_t arm, int n)
 {
-    display_log(DISPLAY_NEWLINE, "give semaphore mid");
-    xSemaphoreGive(arm_mid_air_mutex);
+    const topology_arm_t* info = &topology_arms[arm];
+    int previous = (n + info->waypoint_count - 1) % info->waypoint_count;
+    uint8_t from[TOPOLOGY_AXES];
+    uint8_t to[TOPOLOGY_AXES];
+
+    teach_get_waypoint(arm, previous, from);
+    teach_get_waypoint(arm, n, to);
+    TickType_t time = motion_predict(arm, from, to);
+
+    if(!arm_is_via_point(info, n)) {
+        time += ARM_SETTLE_TIME + TASK_DELAY;
+    }
+    return time;
 }
 
+/**
+ * @brief       Tells the source belt when the arm will grab the next block
+ *              and how long a cycle takes, predicted by the motion model.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: the arm / n: index of the waypoint the arm moves to next
+ *
+ *  @return     none
+ **/
+static void arm_signal_progress(arm_id_t arm, int n)
+{
+    const topology_arm_t* info = &topology_arms[arm];
+    int steps_until_grab = (arms[arm].roles.grab - n + info->waypoint_count) % info->waypoint_count;
+    TickType_t until_grab = 0;
+    TickType_t cycle = 0;
+
+    for(int step = 0; step < info->waypoint_count; step++) {
+        TickType_t time = arm_move_time(arm, (n + step) % info->waypoint_count);
+        cycle += time;
+        if(step < steps_until_grab) {
+            until_grab += time;
+        }
+    }
+    bcs_signal_arm_progress(info->source, until_grab, cycle);
+}
 
 /**
- * @brief       Task for left and right arm.
+ * @brief       Task for an arm of the topology.
+ *              Via-points are streamed: the next waypoint is sent as soon as
+ *              the arm is within ARM_BLEND_RADIUS, without a stop.
  *
  *  @type       public
  *
- *  @param[in]  *pvData chose left(0) or right(1) arm
+ *  @param[in]  *pvData index of the arm in topology_arms
  *
  *  @return     none
 **/
 void move_roboter(void *pv_data)
 {
 
-    enum arm_select left_right_sel = (enum arm_select)pv_data;
-    uint8_t *pos_arm;
-    int id_arm_comand_request;
+    arm_id_t arm = (arm_id_t)(uintptr_t)pv_data;
+    const topology_arm_t* info = &topology_arms[arm];
+    uint8_t pos_arm[TOPOLOGY_AXES];
+    int8_t location = 0; //location of the block on the source belt
 
     /* Init */
-    if(left_right_sel == arm_right) {
-        static uint8_t pos_arm_right[11][6] = {
-            /*                      Arm    B     S     E     H     G  */
-            /*0 Nullposition     */ {0x02, 0x00, 0x19, 0x1A, 0x21, 0x01},
-            /*1 StartPosition    */ {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x01},
-            /*2 Zp1 FB Links     */ {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x00},
-            /*3 Zp2 FB Links     */ {0x02, 0x00, 0x19, 0x1A, 0x21, 0x00},
-            /*4 G offen FB Links */ {0x02, 0xee, 0x00, 0x40, 0x21, 0x00},
-            /*5 G zu FB Links    */ {0x02, 0xD2, 0x00, 0x2b, 0x21, 0x00},
-            /*6 Zp1 FB Mitte     */ {0x02, 0xD2, 0x1c, 0x1d, 0x21, 0x00},
-            /*7 Zp2 FB Mitte     */ {0x02, 0xD2, 0x1c, 0x1d, 0x21, 0x01},
-            /*8 G zu FB Mitte    */ {0x02, 0xD2, 0x13, 0x1d, 0x21, 0x01},
-            /*9 G offen FB Mitte */ {0x02, 0xD2, 0x00, 0x36, 0x21, 0x01},
-            {0x02, 0xEE, 0x00, 0x36, 0x21, 0x01},
-        };
-
-        arm_mid_air_mutex = xSemaphoreCreateBinary();
-        xSemaphoreGive(arm_mid_air_mutex);
-
-        robot_right_queue = xQueueCreate(MSG_QUEUE_SIZE, sizeof(CARME_CAN_MESSAGE));
-        ucan_link_message_to_queue(ROBOT_R_STATUS_RETURN_ID, robot_right_queue);
-
-        pos_arm = (uint8_t *)pos_arm_right;
-        id_arm_comand_request = ROBOT_R_COMAND_REQUEST_ID;
-
-        ucan_send_data(0, ROBOT_R_RESET_ID, 0);
-    }
-
-    if(left_right_sel == arm_left) {
-        static uint8_t pos_arm_left[11][6] = {
-            /*                      Arm    B     S     E     H     G     x     x */
-            {0x02, 0x00, 0x19, 0x1A, 0x21, 0x01}, //Warte Position ECTS Abholen
-            {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x01}, //ECTS Holen Mitte
-            {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x00}, //ECTS Greifen
-            {0x02, 0x00, 0x19, 0x1A, 0x21, 0x00}, //ECTS Anheben
-            {0x02, 0x12, 0x00, 0x40, 0x21, 0x00}, //Drehen bis pos 1
-            {0x02, 0x2D, 0x00, 0x2b, 0x21, 0x00}, //Drehen bis pos 2 bereit zum ablegen
-            {0x02, 0x2D, 0x1c, 0x1d, 0x21, 0x00}, //ECTS Ablegen
-            {0x02, 0x2D, 0x1c, 0x1d, 0x21, 0x01}, //ECTS Ablegen
-            {0x02, 0x2D, 0x13, 0x1d, 0x21, 0x01}, //Arm auserhalb ects
-            {0x02, 0x2D, 0x00, 0x36, 0x21, 0x01}, //Arm ausserhalb mitte
-            {0x02, 0x12, 0x00, 0x36, 0x21, 0x01}, //Arm ausserhalb mitte
-        };
-
-        pos_arm = (uint8_t *)pos_arm_left;
-        id_arm_comand_request = ROBOT_L_COMAND_REQUEST_ID;
-
-        robot_left_queue = xQueueCreate(MSG_QUEUE_SIZE, sizeof(CARME_CAN_MESSAGE));
-        ucan_link_message_to_queue(ROBOT_L_STATUS_RETURN_ID, robot_left_queue);
-
-        ucan_send_data(0, ROBOT_L_RESET_ID, 0 );
-    }
+    ucan_send_data(0, info->can_base + ROBOT_RESET_ID, 0);
 
     vTaskDelay(500); //needed for reset to be applied
 
-    while(1) {
+    TickType_t stage_start = xTaskGetTickCount(); //start of the current waypoint, for the metrics
 
-        for(int n = 0; n < 11; n++) {
-            display_log(DISPLAY_NEWLINE, "Going to position %u",n);
+    while(1) {
 
-            //before we want to grab the block
-            if(n==1) {
-                int8_t pos;
-                pos = bcs_grab(left_right_sel);
-                display_log(DISPLAY_NEWLINE,"block is at pos %d",pos);
+        for(int n = 0; n < info->waypoint_count; n++) {
+            LOG(ARM, LOG_DEBUG, DISPLAY_NEWLINE, "Going to position %u",n);
+            dashboard_arm_update(arm, n);
+            arm_signal_progress(arm, n);
+            if(n == 0) {
+                motion_export(arm);
             }
 
-            if(n == 6) { //before we want to access the mid position
-                arm_enter_critical_air_space();
+            //before we approach the block: start as soon as it arrives at the end of the belt when we arrive
+            if(n==arms[arm].roles.grab) {
+                location = bcs_expect(info->source);
+                LOG(ARM, LOG_INFO, DISPLAY_NEWLINE,"block is at pos %d",location);
+                arm_waypoint(arm, n, location, pos_arm);
+                bcs_await_arrival(info->source, arms[arm].position_valid ? motion_predict(arm, arms[arm].position, pos_arm) : 0);
             }
 
-            if(n==7) { //before we open the grip (to drop the block)
-                bcs_prepare_drop(belt_mid);
+            if(n==arms[arm].roles.grip) { //before we close the grip, the block has to be there
+                bcs_grab(info->source);
             }
 
+            if(n==arms[arm].roles.release) { //before we open the grip (to drop the block)
+                bcs_prepare_drop(info->target);
+            }
 
+            stage_start = metrics_record(METRICS_ARM(arm), METRICS_ARM_WAIT, stage_start); //time blocked by belts
 
-            ucan_send_data(COMAND_DLC, id_arm_comand_request, &pos_arm[n*6] );
-            wait_until_pos(&pos_arm[n*6], left_right_sel);
+            if(arm_enter_air_space(arm, n)) {
+                stage_start = metrics_record(METRICS_ARM(arm), METRICS_ARM_AIRSPACE, stage_start); //time blocked by the other arms
+            }
 
-            if(n==3) { //after we picked up a block
-                bcs_signal_band_free(left_right_sel);
+            bool via_point = arm_is_via_point(info, n);
+            arm_waypoint(arm, n, location, pos_arm);
+            arm_move(arm, pos_arm, via_point ? ARM_BLEND_RADIUS : ARM_STOP_TOLERANCE);
+            if(!via_point) {
+                vTaskDelay(ARM_SETTLE_TIME + TASK_DELAY);
             }
 
-            if(n== 8) { //after we dropped a block
-                bcs_signal_dropped(belt_mid);
+            if(n==arms[arm].roles.lifted) { //after we picked up a block
+                bcs_signal_band_free(info->source);
             }
 
-            if(n == 9) { //after we moved out of the mid position
-                arm_leave_critical_air_space();
+            if(n==arms[arm].roles.released) { //after we dropped a block
+                bcs_signal_dropped(info->target);
+                bcs_signal_delivered(info->source);
+                dashboard_count_block(arm);
             }
 
+            arm_leave_air_space(arm, n);
 
-            vTaskDelay(TASK_DELAY);
+            stage_start = metrics_record(METRICS_ARM(arm), n, stage_start);
         }
     }
 }
 
 /**
- * @brief       Checks the arm position and waits until the desired position
- *              is reached.
+ * @brief       Returns the distance between two positions, i.e. the largest
+ *              difference of all joints (including the gripper).
  *
- *  @type       public
+ *  @type       static
  *
- *  @param[in]  *pos: the position to reach / side: left or right arm
+ *  @param[in]  *a, *b: the positions
  *
- *  @return     none
+ *  @return     the distance in units
  **/
-static void wait_until_pos(uint8_t *pos, enum arm_select side)
+static uint8_t arm_distance(const uint8_t *a, const uint8_t *b)
 {
-    uint8_t *temp = (uint8_t *)pos;
-    bool close_enough = false;
+    uint8_t distance = 0;
 
-    if(side == arm_right) {
-        //display_log(DISPLAY_NEWLINE, "Right arm wait until position reached");
+    for(int i=1; i<TOPOLOGY_AXES; i++) {
+        uint8_t d = abs((int8_t)a[i]-(int8_t)b[i]); //the joints are signed, the right arm turns its base to negative angles
+        distance = d > distance ? d : distance;
+    }
+    return distance;
+}
 
-        while(close_enough != true) {
-            vTaskDelay(200);
-            ucan_send_data(STATUS_REQEST_DLC, ROBOT_R_STATUS_REQUEST_ID, status_request );
+/**
+ * @brief       Returns the time until the next status request: a part of the
+ *              predicted time until the arm is within the tolerance.
+ *              Long moves are polled slowly, the last units fast.
+ *
+ *  @type       static
+ *
+ *  @param[in]  distance: current distance to the target /
+ *              tolerance: max joint error at the target
+ *
+ *  @return     the delay in ticks
+ **/
+static TickType_t arm_poll_delay(uint8_t distance, uint8_t tolerance)
+{
+    TickType_t remaining = distance > tolerance ? (distance - tolerance) * ARM_MS_PER_UNIT / portTICK_PERIOD_MS : 0;
+    TickType_t delay = remaining * 3 / 4;
 
+    if(delay < ARM_POLL_MIN) {
+        return ARM_POLL_MIN;
+    }
+    return delay > ARM_POLL_MAX ? ARM_POLL_MAX : delay;
+}
 
-            xQueueReceive(robot_right_queue, (void *)&robot_msg_buffer_right, portMAX_DELAY);
-            close_enough = true;
-            for(int i=1; i<6; i++) {
-                if(abs(temp[i]-robot_msg_buffer_right.data[i])>0x01) {
-                    close_enough = false;
-                    break;
-                }
-            }
+/**
+ * @brief       Waits for a status response of an arm and stores the position.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: index of the arm / timeout: time in ticks to wait on the response
+ *
+ *  @return     true if the position was received
+ **/
+static bool arm_receive_position(arm_id_t arm, TickType_t timeout)
+{
+    arm_t* state = &arms[arm];
+    CARME_CAN_MESSAGE response;
+
+    if(xQueueReceive(state->queue, (void *)&response, timeout) == pdFALSE) {
+        return false;
+    }
+    memcpy(state->position, response.data, TOPOLOGY_AXES);
+    state->position_valid = true;
+    return true;
+}
+
+/**
+ * @brief       Requests the position of an arm and waits for the response.
+ *              A late response to an earlier request is dropped first.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: index of the arm / timeout: time in ticks to wait on the response
+ *
+ *  @return     true if the position was received (stored in the state of the arm)
+ **/
+static bool arm_read_position(arm_id_t arm, TickType_t timeout)
+{
+    CARME_CAN_MESSAGE response;
+
+    xQueueReceive(arms[arm].queue, (void *)&response, 0); //drop a late response
+    ucan_send_data(STATUS_REQEST_DLC, topology_arms[arm].can_base + ROBOT_STATUS_REQUEST_ID, status_request );
+
+    return arm_receive_position(arm, timeout);
+}
+
+/**
+ * @brief       Takes the response to the previous status request, if it
+ *              arrived, and requests the position again without waiting.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: index of the arm
+ *
+ *  @return     true if a position was received (stored in the state of the arm)
+ **/
+static bool arm_poll_position(arm_id_t arm)
+{
+    bool received = arm_receive_position(arm, 0);
+
+    ucan_send_data(STATUS_REQEST_DLC, topology_arms[arm].can_base + ROBOT_STATUS_REQUEST_ID, status_request );
+    return received;
+}
+
+/**
+ * @brief       Sends a position command to an arm. A command which is not
+ *              acknowledged is sent again: the readback cannot tell a lost
+ *              gripper command, open and closed differ by 1 only (see
+ *              ARM_STOP_TOLERANCE).
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: index of the arm / *pos: the position
+ *
+ *  @return     none
+ **/
+static void arm_send_command(arm_id_t arm, const uint8_t *pos)
+{
+    const topology_arm_t* info = &topology_arms[arm];
 
+    for(uint8_t attempt = 1; attempt <= ARM_SEND_RETRIES; attempt++) {
+        if(ucan_send_data_wait(COMAND_DLC, info->can_base + ROBOT_COMAND_REQUEST_ID, pos, ARM_SEND_TIMEOUT)) {
+            return;
         }
-        //display_log(DISPLAY_NEWLINE, "Right arm reached position");
-    } else {
-        //display_log(DISPLAY_NEWLINE, "Left arm wait until position reached");
-        while(close_enough != true) {
+        LOG(ARM, LOG_WARN, DISPLAY_NEWLINE, "%s: command not acknowledged (%u)", info->name, attempt);
+    }
+}
 
-            vTaskDelay(200);
+/**
+ * @brief       Checks the arm position and waits until the desired position
+ *              is reached, i.e. all joints are within the tolerance.
+ *              The status is polled adaptively (see arm_poll_delay). A lost
+ *              response is requested again after ARM_STATUS_TIMEOUT, after
+ *              ARM_STATUS_RETRIES lost responses the command is repeated.
+ *              The command is repeated as well if the arm still reports its
+ *              status but is not there ARM_MOVE_MARGIN after the time
+ *              predicted by the motion model (the command was lost).
+ *
+ *  @type       public
+ *
+ *  @param[in]  *pos: the position to reach / arm: index of the arm /
+ *              tolerance: max joint error in units
+ *
+ *  @return     none
+ **/
+static void wait_until_pos(uint8_t *pos, arm_id_t arm, uint8_t tolerance)
+{
+    const topology_arm_t* info = &topology_arms[arm];
+    arm_t* state = &arms[arm];
+    uint8_t distance = arm_distance(pos, state->position); //predicted from the last known position
+    uint8_t failures = 0;
+    TickType_t command = xTaskGetTickCount(); //the command was sent right before
+    uint8_t from[TOPOLOGY_AXES];
+    uint32_t arrived[TOPOLOGY_AXES] = {0}; //time in ms until each joint arrived, for the motion model
+    bool measured = state->position_valid; //a move is only measured from a known position, without repeated commands
+
+    memcpy(from, state->position, TOPOLOGY_AXES);
+    TickType_t deadline = command + motion_predict(arm, from, pos) + ARM_MOVE_MARGIN; //latest expected arrival
+
+    while(true) {
+        vTaskDelay(failures > 0 ? ARM_POLL_MIN : arm_poll_delay(distance, tolerance));
+
+        if(!arm_read_position(arm, ARM_STATUS_TIMEOUT)) {
+            failures++;
+            LOG(ARM, LOG_WARN, DISPLAY_NEWLINE, "%s: no status (%u)", info->name, failures);
+            if(failures % ARM_STATUS_RETRIES == 0) { //the command may be lost as well
+                LOG(ARM, LOG_ERROR, DISPLAY_NEWLINE, "%s: repeating command", info->name);
+                arm_send_command(arm, pos);
+                measured = false;
+            }
+            continue;
+        }
 
-            ucan_send_data(STATUS_REQEST_DLC, ROBOT_L_STATUS_REQUEST_ID, status_request );
+        failures = 0;
+        uint32_t elapsed = (xTaskGetTickCount() - command) * portTICK_PERIOD_MS;
+        for(int i = 1; i < TOPOLOGY_AXES; i++) {
+            if(arrived[i] == 0 && abs((int8_t)state->position[i] - (int8_t)pos[i]) <= ARM_STOP_TOLERANCE) {
+                arrived[i] = elapsed > 0 ? elapsed : 1;
+            }
+        }
 
-            xQueueReceive(robot_left_queue, (void *)&robot_msg_buffer_left, portMAX_DELAY);
-            close_enough = true;
-            for(int i=1; i<6; i++) {
-                if(abs(temp[i]-robot_msg_buffer_left.data[i])>0x01) {
-                    close_enough = false;
-                    break;
-                }
+        distance = arm_distance(pos, state->position);
+        if(distance <= tolerance) {
+            if(measured) {
+                motion_record(arm, from, pos, arrived);
             }
+            return;
         }
 
-        //display_log(DISPLAY_NEWLINE, "Left arm reached position");
+        TickType_t now = xTaskGetTickCount();
+        if((int32_t)(now - deadline) >= 0) { //the arm answers, but does not get there
+            LOG(ARM, LOG_ERROR, DISPLAY_NEWLINE, "%s: not arrived in time, repeating command", info->name);
+            arm_send_command(arm, pos);
+            measured = false;
+            deadline = now + motion_predict(arm, state->position, pos) + ARM_MOVE_MARGIN;
+        }
     }
-    vTaskDelay(1000);
 }
 
 /**
- * @brief       Creates the arm tasks.
+ * @brief       Moves the arm of an arm task to a position and waits until it
+ *              is within the tolerance. The arm task holds the control of the
+ *              arm meanwhile, so the manual task only takes over between two
+ *              moves (the arm task is parked on the control until it is
+ *              given back). If the manual task moved the arm, the arm first
+ *              returns to the position the arm task commanded last.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: index of the arm / *pos: the position /
+ *              tolerance: max joint error in units
+ *
+ *  @return     none
+ **/
+static void arm_move(arm_id_t arm, uint8_t *pos, uint8_t tolerance)
+{
+    const topology_arm_t* info = &topology_arms[arm];
+    arm_t* state = &arms[arm];
+
+    xSemaphoreTake(state->control, portMAX_DELAY);
+    if(state->taken_over) {
+        state->taken_over = false;
+        LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "%s: resuming", info->name);
+        arm_send_command(arm, state->commanded);
+        wait_until_pos(state->commanded, arm, ARM_STOP_TOLERANCE);
+    }
+    memcpy(state->commanded, pos, TOPOLOGY_AXES);
+    arm_send_command(arm, pos);
+    wait_until_pos(pos, arm, tolerance);
+    xSemaphoreGive(state->control);
+    taskYIELD(); //a waiting manual task takes over before the next move
+}
+
+/**
+ * @brief       Creates one task per arm of the topology and the task of the
+ *              manual arm movement.
  *
  *  @type       public
  *
@@ -322,32 +690,111 @@ static void wait_until_pos(uint8_t *pos, enum arm_select side)
  **/
 void init_arm()
 {
+    airspace_init();
+    motion_init();
 
-    xTaskCreate(move_roboter,
-                "Arm Left",
-                ARM_TASK_STACKSIZE,
-                (void*)arm_left,
-                ARM_TASK_PRIORITY,
-                NULL);
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        const topology_arm_t* info = &topology_arms[arm];
 
-    xTaskCreate(move_roboter,
-                "Arm Right",
-                ARM_TASK_STACKSIZE,
-                (void*)arm_right,
-                ARM_TASK_PRIORITY,
-                NULL);
-    /*
+        if(!arm_find_roles(arm)) {
+            LOG(ARM, LOG_ERROR, DISPLAY_NEWLINE, "%s: gripper never closes and opens", info->name);
+            continue;
+        }
+        arm_build_grasp_table(arm);
+        teach_get_waypoint(arm, 0, arms[arm].commanded);
+
+        arms[arm].control = xSemaphoreCreateMutex();
+        arms[arm].queue = xQueueCreate(MSG_QUEUE_SIZE, sizeof(CARME_CAN_MESSAGE));
+        ucan_link_message_to_queue(info->can_base + ROBOT_STATUS_RETURN_ID, arms[arm].queue);
+
+        xTaskCreate(move_roboter,
+                    info->name,
+                    ARM_TASK_STACKSIZE,
+                    (void*)(uintptr_t)arm,
+                    ARM_TASK_PRIORITY,
+                    NULL);
+    }
     xTaskCreate(manual_arm_movement,
-                "Manual Arm Movement",
+                "Manual Arm",
                 ARM_TASK_STACKSIZE,
                 NULL,
                 ARM_TASK_PRIORITY,
-                NULL);*/
+                NULL);
+}
+
+/**
+ * @brief       Handles the buttons in teach mode: selects a waypoint of the
+ *              arm, replaces it by the current position or saves all waypoints.
+ *
+ *  @type       static
+ *
+ *  @param[in]  arm: the selected arm / pressed: buttons pressed since the last call /
+ *              position: last reported position of the arm, NULL if there is none
+ *
+ *  @param[in,out] waypoint: index of the selected waypoint
+ *
+ *  @return     none
+ **/
+static void arm_teach(arm_id_t arm, uint8_t pressed, const uint8_t *position, uint8_t *waypoint)
+{
+    uint8_t count = topology_arms[arm].waypoint_count;
+
+    if(*waypoint >= count) {
+        *waypoint = 0;
+    }
+
+    switch(pressed) {
+    case BUTTON_T0:
+        *waypoint = (*waypoint + 1) % count;
+        break;
+    case BUTTON_T1:
+        *waypoint = (*waypoint + count - 1) % count;
+        break;
+    case BUTTON_T2:
+        if(position != NULL) {
+            teach_capture(arm, *waypoint, position);
+        }
+        return;
+    case BUTTON_T3:
+        teach_save();
+        return;
+    default:
+        return;
+    }
+    LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "Teach %s wp%u", topology_arms[arm].name, *waypoint);
 }
 
 /**
- * @brief       Task to move the roboter with the Buttons. To create this
- *              task unkomment it in the function init_arm()
+ * @brief       Returns the jog speed selected with the poti
+ *
+ *  @type       static
+ *
+ *  @return     speed in units per second, ARM_JOG_SPEED_MIN to ARM_JOG_SPEED_MAX
+ **/
+static uint32_t arm_jog_speed(void)
+{
+    uint16_t value = 0;
+
+    CARME_IO2_ADC_Get(CARME_IO2_ADC_PORT0, &value);
+    if(value > ARM_JOG_ADC_MAX) {
+        value = ARM_JOG_ADC_MAX;
+    }
+    return ARM_JOG_SPEED_MIN + (uint32_t)value * (ARM_JOG_SPEED_MAX - ARM_JOG_SPEED_MIN) / ARM_JOG_ADC_MAX;
+}
+
+/**
+ * @brief       Task to move the roboter with the Buttons. In manual mode
+ *              (switch 4) it takes the control of the selected arm from the
+ *              arm task, which parks before its next move, and gives it back
+ *              when manual mode ends or the other arm is selected. The arm
+ *              task then returns to its last commanded position and goes on.
+ *
+ *              The joints are jogged every ARM_JOG_PERIOD: the poti sets the
+ *              speed, which grows while a button is held (up to
+ *              ARM_JOG_GAIN_MAX times). A command is only sent when the
+ *              target changed and is not waited on; the position is read
+ *              back every ARM_JOG_READBACK. Jogging starts at the reported
+ *              position, so selecting an arm does not move it.
  *
  *  @type       public
  *
@@ -358,108 +805,119 @@ void init_arm()
 void manual_arm_movement(void *pvData)
 {
     /*
-     * Switch 0: select left or right arm
-     * Switch 1: increment or decrement position value
-     * Switch 2: gripper open or close
+     * Switches: see switches.h (SWITCH_ARM_*)
+     *
+     * Button 0: jog basis       / teach: next waypoint
+     * Button 1: jog shoulder    / teach: previous waypoint
+     * Button 2: jog elbow       / teach: store the position as the waypoint
+     * Button 3: jog hand        / teach: save all waypoints to the EEPROM
      *
-     * Button 0: change value of basis
-     * Button 1: change value of shoulder
-     * Button 2: change value of elbow
-     * Button 3: change value of hand
+     * Poti: jog speed
      */
 
     uint8_t button_data;
     uint8_t switch_data;
-
-    uint8_t pos_manuel[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
-    bool increment = false;
-    bool left_select = false;
-
-    CARME_CAN_MESSAGE robot_msg_buffer_manual;
-    robot_manual_queue = xQueueCreate(MSG_QUEUE_SIZE, sizeof(CARME_CAN_MESSAGE));
-    ucan_link_message_to_queue(ROBOT_R_STATUS_RETURN_ID, robot_manual_queue);
-    ucan_link_message_to_queue(ROBOT_L_STATUS_RETURN_ID, robot_manual_queue);
+    uint8_t last_buttons = 0;
+    uint8_t teach_waypoint = 0;
+    uint8_t position_line = DISPLAY_NEWLINE;
+
+    uint8_t target[TOPOLOGY_AXES];
+    bool has_target = false; // target initialized from the reported position
+    arm_id_t arm = ARM_RIGHT;
+    bool manual = false; // the control of the arm is taken from the arm task
+    uint32_t held = 0; // time in ms the jog buttons are held
+    uint32_t fraction = 0; // travelled part of a unit, in units * ms per second
+    TickType_t last_wake = xTaskGetTickCount();
+    TickType_t last_readback = last_wake - ARM_JOG_READBACK;
 
     while(1) {
+        vTaskDelayUntil(&last_wake, ARM_JOG_PERIOD);
         CARME_IO1_BUTTON_Get(&button_data);
         CARME_IO1_SWITCH_Get(&switch_data);
 
-        if( (switch_data & MASK_SWITCH_0) != 0) {
-            left_select = true;
-        } else {
-            left_select = false;
+        arm_id_t selected = (switch_data & SWITCH_ARM_LEFT) != 0 ? ARM_LEFT : ARM_RIGHT;
+        bool enabled = (switch_data & SWITCH_ARM_MANUAL) != 0;
+        if(manual && (!enabled || selected != arm)) { // hand the arm back to its task
+            xSemaphoreGive(arms[arm].control);
+            manual = false;
+            LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "%s: automatic", topology_arms[arm].name);
+        }
+        arm = selected;
+        if(!enabled || arms[arm].control == NULL) {
+            continue;
+        }
+        if(!manual) {
+            if(xSemaphoreTake(arms[arm].control, ARM_JOG_READBACK) == pdFALSE) {
+                continue; // the arm task is still moving
+            }
+            manual = true;
+            has_target = false;
+            last_readback = xTaskGetTickCount() - ARM_JOG_READBACK;
+            last_wake = xTaskGetTickCount();
+            LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "%s: manual", topology_arms[arm].name);
         }
 
-        if( (switch_data & MASK_SWITCH_1 ) != 0) {
-            increment = true;
-        } else {
-            increment = false;
+        if(last_wake - last_readback >= ARM_JOG_READBACK) {
+            last_readback = last_wake;
+            if(arm_poll_position(arm)) {
+                const uint8_t *position = arms[arm].position;
+                position_line = LOG(ARM, LOG_INFO, position_line, "Position: %x %x %x %x %x %x", position[0], position[1],
+                                    position[2], position[3], position[4], position[5]);
+            }
         }
 
-        if( (switch_data & MASK_SWITCH_2) != 0) {
-            pos_manuel[5] = GRIPPER_MAX;
+        if( (switch_data & SWITCH_ARM_TEACH) != 0) {
+            arm_teach(arm, button_data & ~last_buttons, arms[arm].position_valid ? arms[arm].position : NULL, &teach_waypoint);
+            last_buttons = button_data;
+            button_data = 0; //no jogging while teaching
         } else {
-            pos_manuel[5] = GRIPPER_MIN;
+            last_buttons = button_data;
         }
 
-        switch(button_data) {
-
-        case BUTTON_T0:
-            if(increment == true) {
-                pos_manuel[1]++;
-            } else {
-                pos_manuel[1]--;
+        if(!has_target) {
+            if(!arms[arm].position_valid) {
+                continue; // wait for the readback
             }
-            break;
+            memcpy(target, arms[arm].position, TOPOLOGY_AXES);
+            target[0] = topology_arms[arm].waypoints[0][0];
+            has_target = true;
+        }
 
-        case BUTTON_T1:
-            if(increment == true) {
-                pos_manuel[2]++;;
-            } else {
-                pos_manuel[2]--;
-            }
-            break;
+        bool changed = false;
+        uint8_t gripper = (switch_data & SWITCH_ARM_GRIPPER) != 0 ? GRIPPER_MAX : GRIPPER_MIN;
+        if(target[ARM_GRIPPER_AXIS] != gripper) {
+            target[ARM_GRIPPER_AXIS] = gripper;
+            changed = true;
+        }
 
-        case BUTTON_T2:
-            if(increment == true) {
-                pos_manuel[3]++;
-            } else {
-                pos_manuel[3]--;
+        uint8_t jog = button_data & (BUTTON_T0 | BUTTON_T1 | BUTTON_T2 | BUTTON_T3);
+        if(jog == 0) {
+            held = 0;
+            fraction = 0;
+        } else {
+            uint32_t gain = 1 + held / ARM_JOG_RAMP;
+            held += ARM_JOG_PERIOD * portTICK_PERIOD_MS;
+            fraction += arm_jog_speed() * (gain < ARM_JOG_GAIN_MAX ? gain : ARM_JOG_GAIN_MAX) * ARM_JOG_PERIOD * portTICK_PERIOD_MS;
+            int step = fraction / 1000;
+            fraction %= 1000;
+
+            if( (switch_data & SWITCH_ARM_INCREMENT) == 0) {
+                step = -step;
             }
-            break;
-
-        case BUTTON_T3:
-            if(increment == true) {
-                pos_manuel[4]++;
-            } else {
-                pos_manuel[4]--;
+            for(uint8_t joint = 1; step != 0 && joint < ARM_GRIPPER_AXIS; joint++) {
+                if( (jog & (BUTTON_T0 << (joint - 1))) != 0) {
+                    int value = (int8_t)target[joint] + step; // the joints are signed
+                    value = value > INT8_MAX ? INT8_MAX : value < INT8_MIN ? INT8_MIN : value;
+                    changed |= (int8_t)target[joint] != value;
+                    target[joint] = (uint8_t)value;
+                }
             }
-            break;
-        default:
-            break;
         }
 
-        if(left_select == true) {
-            ucan_send_data(COMAND_DLC, ROBOT_L_COMAND_REQUEST_ID, pos_manuel);
-            vTaskDelay(20);
-            ucan_send_data(STATUS_REQEST_DLC, ROBOT_L_STATUS_REQUEST_ID, status_request );
-            vTaskDelay(20);
-            xQueueReceive(robot_manual_queue, (void *)&robot_msg_buffer_manual, portMAX_DELAY);
-            vTaskDelay(20);
-        } else {
-            ucan_send_data(COMAND_DLC, ROBOT_R_COMAND_REQUEST_ID, pos_manuel);
-            vTaskDelay(20);
-            ucan_send_data(STATUS_REQEST_DLC, ROBOT_R_STATUS_REQUEST_ID, status_request );
-            xQueueReceive(robot_manual_queue, (void *)&robot_msg_buffer_manual, portMAX_DELAY);
-            vTaskDelay(20);
+        if(changed) {
+            ucan_send_data(COMAND_DLC, topology_arms[arm].can_base + ROBOT_COMAND_REQUEST_ID, target); // the readback shows where the arm is
+            arms[arm].taken_over = true;
         }
-
-        display_log(DISPLAY_NEWLINE,"Position: %x %x %x %x %x %x",robot_msg_buffer_right.data[0],
-                    robot_msg_buffer_manual.data[1],
-                    robot_msg_buffer_manual.data[2],
-                    robot_msg_buffer_manual.data[3],
-                    robot_msg_buffer_manual.data[4],
-                    robot_msg_buffer_manual.data[5]);
     }
 }
 
@@ -25,26 +25,69 @@
 
 
 
-#include "display.h"
+#include "loglevel.h"
 #include <FreeRTOS.h>
 #include <stdio.h>
 #include <task.h>
 #include <queue.h>
-#include <semphr.h>
+#include <event_groups.h>
 #include <stdbool.h>
 #include <string.h>
+#include <carme_io1.h>
 #include "ucan.h"
 #include "bcs.h"
+#include "dashboard.h"
+#include "metrics.h"
+#include "switches.h"
 
 // -------------------- Configuration  ------------
 #define STACKSIZE_TASK  256 //!< Stack size of all bcs tasks
 #define PRIORITY_TASK   2 //!< Priority of all bcs tasks
 
-#define MAX_BLOCK_COUNT 3 //!< Number of blocks to work with. Must be between 2 and 4
+#ifndef MAX_BLOCK_COUNT
+#define MAX_BLOCK_COUNT 4 //!< Number of blocks to work with. Must be between 2 and 7: the cell has 8 slots (drop and end zone of the three belts, the grippers of the two arms), with all of them filled it deadlocks. Fewer blocks cannot, the dispatcher never waits on a full side (see \ref bcs_side_full). Override with -D.
+#endif
+#if MAX_BLOCK_COUNT < 2 || MAX_BLOCK_COUNT > 7
+#error "MAX_BLOCK_COUNT must be between 2 and 7"
+#endif
+
+#ifndef BCS_STATUS_PERIOD
+#define BCS_STATUS_PERIOD       10 //!< Min time in ticks between two status requests to the same belt (bus load ~25% with three belts). Override with -D.
+#endif
+#define BCS_STATUS_TIMEOUT      100 //!< Time in ticks to wait on a status response before the request is repeated
+#define BCS_DETECTION_TIMEOUT   10000 //!< Time in ticks after which the block detection is aborted
+#define BCS_END_TIMEOUT         3000 //!< Max time in ticks the block needs from the detection to the end of the belt (about twice the time at nominal speed, a belt may run 30% slower)
+#define BCS_DISPATCH_TIMEOUT    1000 //!< Max time in ticks the dispatcher needs to push a block off the mid belt
+#define BCS_SWEEP_TIMEOUT       6000 //!< Max time in ticks a block needs from the drop zone to the end of the belt (recovery run)
+#define BCS_CLAIM_TIMEOUT       30000 //!< Time in ticks a task waits on a handoff event before the belt is checked
+#define BCS_SEND_TIMEOUT        50 //!< Max time in ticks until a command is transmitted (the transmit queue of ucan may hold other messages)
+#define BCS_SEND_RETRIES        3 //!< Number of times a command is sent before it counts as failed
+#define BCS_RESET_RETRY         500 //!< Time in ticks before a failed reset of a belt is repeated
+#define BCS_RECOVERY_BUTTON     0x08 //!< Button T3: the operator confirms that a belt with a lost block may resume (with \ref SWITCH_RECOVERY_ACK)
+#define BCS_BUTTON_POLL         50 //!< Time in ticks between two reads of the buttons
+#define BCS_SIDE_SLOTS          3 //!< Blocks a side (a belt without dispatcher and its arm) holds: drop zone, end zone and gripper
+#define BCS_FULL_POLL           50 //!< Time in ticks between two checks of a full target
 
 // ------------------ Implementation --------------
 
-#define SWITCH  ((volatile unsigned char*)(0x6C000400))
+/**
+  @brief How the dispatcher chooses the direction of the next block
+  */
+enum bcs_policy {bcs_policy_alternate, //!< all targets by turns
+                 bcs_policy_manual, //!< direction from the DIP switch
+                 bcs_policy_adaptive, //!< target whose arm will be ready for the block first
+                 bcs_policy_count
+                };
+
+static const char* const bcs_policy_names[bcs_policy_count] = {"alternate", "manual", "adaptive"}; //!< Names for the log
+
+/**
+  @brief Throughput of a dispatcher policy
+  */
+typedef struct {
+    uint16_t blocks; //!< Number of blocks dispatched with the policy (with a measured cycle time)
+    TickType_t cycle_sum; //!< Sum of the cycle times of these blocks
+} bcs_policy_stats_t;
 
 /**
   @brief BCS can message structure
@@ -79,117 +122,364 @@ static const message_t msg_cmd_stoppos = {2,3,{3,0x00,0xB6}};
 static const message_t msg_cmd_done= {2,3,{4,0,0}};
 static const message_t msg_cmd_reset= {0xF,0};
 
-//Messages for dispatcher
-static const message_t msg_cmd_disp_initial_pos = {0x142, 3, {1, 0, 100}};
-static const message_t msg_cmd_disp_start_right = {0x142, 3, {1, 0xE4, 100}};
-static const message_t msg_cmd_disp_move_right = {0x142, 3, {1, 0x32, 50}};
-static const message_t msg_cmd_disp_start_left = {0x142, 3, {1, 0x1C, 100}};
-static const message_t msg_cmd_disp_move_left = {0x142, 3, {1, 0xCE, 50}};
+/**
+  @brief Events of a belt (bits in its event group)
+  */
+#define BCS_EV_DROP_FREE    (1 << 0) //!< Drop zone is free. Set by the belt task, claimed before a drop (arm task or dispatching belt task)
+#define BCS_EV_DROPPED      (1 << 1) //!< A block was dropped. Set after a drop, claimed by the belt task
+#define BCS_EV_END_FREE     (1 << 2) //!< End zone is free. Set when the block was removed (arm task or dispatching belt task), claimed by the belt task
+#define BCS_EV_END_READY    (1 << 3) //!< Block waits in the end zone, see location. Set by the belt task, claimed by the arm task (only belts without dispatcher)
+#define BCS_EV_DETECTED     (1 << 4) //!< Block detected on its way to the end zone, see location and detected_at. Set by the belt task, claimed by the arm task (only belts without dispatcher)
+#define BCS_EV_RESYNC       (1 << 5) //!< A task waited \ref BCS_CLAIM_TIMEOUT on the belt. Set by the waiting task, claimed by the belt task, which then checks its belt
 
-//Messages Queues to receive data from can
-static QueueHandle_t ucan_queue_mid;
-static QueueHandle_t ucan_queue_left;
-static QueueHandle_t ucan_queue_right;
+/**
+  @brief States of a belt task. The order is the same as in \ref metrics_bcs_stage
+  */
+enum bcs_state {bcs_state_reset, //!< reset the belt (and the dispatcher)
+                bcs_state_await_drop, //!< wait on a block to be dropped
+                bcs_state_start, //!< wait on the free end zone, then start the belt
+                bcs_state_detect, //!< wait until the block is detected and at the end of the belt
+                bcs_state_dispatch, //!< hand the block over to the arm, or dispatch it
+                bcs_state_done, //!< tell the belt that we are finished
+                bcs_state_recovery //!< a handoff step failed or timed out, resync with the belt and resume
+               };
 
-//Semaphores
-static SemaphoreHandle_t bcs_left_start_semaphore; //Given by mid task, Taken by left
-static SemaphoreHandle_t bcs_mid_start_semaphore; //Given by arm Tasks, taken by Mid task
-static SemaphoreHandle_t bcs_right_start_semaphore; //Given by mid task, Taken by right
-static SemaphoreHandle_t bcs_left_free_semaphore; //Given by left task, Taken by arm task
-static SemaphoreHandle_t bcs_mid_free_semaphore; //Given by mid task, Taken by left/right task
-static SemaphoreHandle_t bcs_right_free_semaphore; //Given by right task, Taken by arm task
+/**
+  @brief Occupancy of a belt. Every belt has two slots: the drop zone at its start and the end zone where the block waits to be removed.
+  A block dropped onto the drop zone is moved to the end as soon as the end zone is free, so the next block can be dropped while the previous one still waits at the end.
+  */
+typedef struct {
+    QueueHandle_t ucan_queue; //!< Queue to receive the data of the belt from can
+    EventGroupHandle_t events; //!< Handoff events of the belt, see BCS_EV_*
+    volatile int8_t location; //!< Location of the block in the end zone (valid from \ref BCS_EV_DETECTED until the block was picked up)
+    volatile TickType_t detected_at; //!< Time the block was detected (only belts without dispatcher)
+    volatile TickType_t travel; //!< Smoothed time in ticks a block needs from the detection to the end of the belt, 0 until measured (only belts without dispatcher)
+    uint8_t blocks; //!< Number of blocks on the belt, including the one which is beeing dropped
+    uint8_t carried; //!< Number of blocks taken from the belt, which its arm did not drop yet (only belts without dispatcher)
+    volatile TickType_t arm_ticks_until_grab; //!< Predicted time until the arm of this belt grabs the next block (only belts without dispatcher)
+    volatile TickType_t arm_ticks_per_cycle; //!< Predicted time of a full arm cycle (only belts without dispatcher)
+    uint16_t recoveries; //!< Number of lost blocks the belt recovered from
+    TickType_t downtime; //!< Total time in ticks from the start of a failed detection until the belt resumed
+} bcs_belt_t;
+
+static bcs_belt_t bcs_belts[TOPOLOGY_MAX_BELTS]; //!< Occupancy of all belts, indexed like \ref topology_belts
 
-static QueueHandle_t bcs_left_end_queue; //Given by left task, Taken by Arm Left
-static QueueHandle_t bcs_right_end_queue; //Given by right task, taken by Arm Right
+/**
+ * @brief       Returns the occupancy of a belt
+ * @type        static
+ * @param[in]   belt    The belt
+ * @return      Pointer to the belt structure
+ **/
+static bcs_belt_t* bcs_get_belt(belt_id_t belt)
+{
+    return &bcs_belts[belt];
+}
+
+/**
+ * @brief       Waits until an event of a belt is set and clears it. Like a semaphore, only one of several waiting tasks gets the event.
+ * @type        static
+ * @param[in]   slots   The belt
+ * @param[in]   event   One of the BCS_EV_* bits
+ * @param[in]   timeout Max time in ticks to wait
+ * @return      true if the event was claimed, false on timeout
+ **/
+static bool bcs_claim(bcs_belt_t* slots, EventBits_t event, TickType_t timeout)
+{
+    while(true) {
+        if(xEventGroupClearBits(slots->events, event) & event) { //atomic test and clear
+            return true;
+        }
+        if(!(xEventGroupWaitBits(slots->events, event, pdFALSE, pdTRUE, timeout) & event)) {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief       Claims an event of a belt for a task other than the belt task. Every \ref BCS_CLAIM_TIMEOUT without the event,
+ *              the belt task is asked to check its belt (\ref BCS_EV_RESYNC), so a block the belt does not know about is found.
+ * @type        static
+ * @param[in]   slots   The belt
+ * @param[in]   event   One of the BCS_EV_* bits
+ * @return      None
+ **/
+static void bcs_claim_checked(bcs_belt_t* slots, EventBits_t event)
+{
+    while(!bcs_claim(slots, event, BCS_CLAIM_TIMEOUT)) {
+        LOG(BCS, LOG_DEBUG, DISPLAY_NEWLINE,"Waited %lu ms on event %lx, checking belt", BCS_CLAIM_TIMEOUT * portTICK_PERIOD_MS, event);
+        xEventGroupSetBits(slots->events, BCS_EV_RESYNC);
+    }
+}
+
+/**
+ * @brief       Claims an event of a belt for the belt task. Gives up after \ref BCS_CLAIM_TIMEOUT or when another task asked
+ *              for a check of the belt, so the belt task can resync with its belt.
+ * @type        static
+ * @param[in]   slots   The belt
+ * @param[in]   event   One of the BCS_EV_* bits
+ * @return      true if the event was claimed, false if the belt has to be checked
+ **/
+static bool bcs_claim_or_check(bcs_belt_t* slots, EventBits_t event)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t waited;
+
+    while((waited = xTaskGetTickCount() - start) < BCS_CLAIM_TIMEOUT) {
+        if(xEventGroupClearBits(slots->events, event) & event) {
+            return true;
+        }
+        if(xEventGroupClearBits(slots->events, BCS_EV_RESYNC) & BCS_EV_RESYNC) {
+            return false;
+        }
+        xEventGroupWaitBits(slots->events, event | BCS_EV_RESYNC, pdFALSE, pdFALSE, BCS_CLAIM_TIMEOUT - waited);
+    }
+    return false;
+}
 
 
 
 /**
- * @brief       Send a CAN message to the belt conveyer system
+ * @brief       Send a CAN message to the belt conveyer system and wait until it was transmitted.
+ *              The gap between two messages to the same belt is kept by ucan.
  * @type        static
  * @param[in]   msg         The message to send
- * @param[in]   baseaddress The base adress for the id
- * @return      none
+ * @param[in]   belt        The belt to send the message to
+ * @return      true if the message was acknowledged, false if it was not after \ref BCS_SEND_RETRIES attempts
+ **/
+static bool bcs_send_msg(const message_t* msg, belt_id_t belt)
+{
+    for(uint8_t attempt = 1; attempt <= BCS_SEND_RETRIES; attempt++) {
+        if(ucan_send_data_wait(msg->length,topology_belts[belt].can_base + msg->subid, msg->data, BCS_SEND_TIMEOUT)) {
+            return true;
+        }
+        LOG(BCS, LOG_WARN, DISPLAY_NEWLINE,"%s: message %u not acknowledged (%u)",topology_belts[belt].name,msg->subid,attempt);
+    }
+    return false;
+}
+
+/**
+ * @brief       Send a command to a dispatcher
+ * @type        static
+ * @param[in]   dispatcher  The dispatcher
+ * @param[in]   cmd         The command (one of the commands in the dispatcher structure)
+ * @return      true if the command was acknowledged, false if it was not after \ref BCS_SEND_RETRIES attempts
  **/
-static void bcs_send_msg(const message_t* msg, uint16_t baseaddr)
+static bool bcs_send_dispatcher(const topology_dispatcher_t* dispatcher, const uint8_t cmd[3])
 {
-    ucan_send_data(msg->length,baseaddr + msg->subid, msg->data);
-    vTaskDelay(5);
+    for(uint8_t attempt = 1; attempt <= BCS_SEND_RETRIES; attempt++) {
+        if(ucan_send_data_wait(3,dispatcher->can_id,cmd,BCS_SEND_TIMEOUT)) {
+            return true;
+        }
+        LOG(BCS, LOG_WARN, DISPLAY_NEWLINE,"Dispatcher: command not acknowledged (%u)",attempt);
+    }
+    return false;
 }
 
 
 /**
- * @brief       Waits until a block is detected on the specified belt
+ * @brief       Waits on the status response of a belt
+ * @type        static
+ * @param[in]   belt            The belt which was asked for its status
+ * @param[in]   queue           The queue to receive the CAN data from
+ * @param[out]  tmp_message     The buffer where to store the temporary CAN messages
+ * @return      A pointer to the status message (valid as long as tmp_message is valid), or NULL on timeout
+ **/
+static status_t* bcs_receive_status(belt_id_t belt, QueueHandle_t ucan_queue, CARME_CAN_MESSAGE* tmp_message)
+{
+    do {
+        if(xQueueReceive(ucan_queue,tmp_message,BCS_STATUS_TIMEOUT)==pdFALSE) {
+            return NULL;
+        }
+    } while(tmp_message->id != topology_belts[belt].can_base+msg_status_response_id); //skip other messages of the belt
+
+    return (status_t*)&(tmp_message->data);
+}
+
+/**
+ * @brief       Requests the status of a belt and waits on the response
+ * @type        static
+ * @param[in]   belt            The belt to ask
+ * @param[in]   queue           The queue to receive the CAN data from
+ * @param[out]  tmp_message     The buffer where to store the temporary CAN messages
+ * @return      A pointer to the status message (valid as long as tmp_message is valid), or NULL on timeout
+ **/
+static status_t* bcs_request_status(belt_id_t belt, QueueHandle_t ucan_queue, CARME_CAN_MESSAGE* tmp_message)
+{
+    if(!bcs_send_msg(&msg_status_request,belt)) {
+        return NULL;
+    }
+    return bcs_receive_status(belt, ucan_queue, tmp_message);
+}
+
+/**
+ * @brief       Waits until the belt stopped at the stop position, i.e. the engine is off and the light barrier sees the block
+ * @type        static
+ * @param[in]   belt            The belt with the block
+ * @param[in]   queue           The queue to receive the CAN data from
+ * @return      true if the belt reported the block at the end, false if \ref BCS_END_TIMEOUT elapsed
+ **/
+static bool bcs_await_end(belt_id_t belt, QueueHandle_t ucan_queue)
+{
+    CARME_CAN_MESSAGE tmp_message;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t last_request = start;
+
+    while(xTaskGetTickCount() - start < BCS_END_TIMEOUT) {
+        status_t* status = bcs_request_status(belt, ucan_queue, &tmp_message);
+        if(status != NULL) {
+            dashboard_belt_update(belt, dashboard_belt_ready, status->position);
+            if(!status->engine && status->lightbarrier) {
+                return true;
+            }
+        }
+        vTaskDelayUntil(&last_request, BCS_STATUS_PERIOD);
+    }
+    return false;
+}
+
+/**
+ * @brief       Waits until the dispatcher pushed the block off its belt, i.e. the light barrier at the end is free again.
+ *              If the light barrier did not see the block in the first place, there is nothing to wait for except the timeout.
+ * @type        static
+ * @param[in]   belt            The belt with the dispatcher
+ * @param[in]   queue           The queue to receive the CAN data of the belt from
+ * @return      true if the light barrier was freed, false if \ref BCS_DISPATCH_TIMEOUT elapsed
+ **/
+static bool bcs_await_dispatched(belt_id_t belt, QueueHandle_t ucan_queue)
+{
+    CARME_CAN_MESSAGE tmp_message;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t last_request = start;
+    bool block_seen = false;
+
+    while(xTaskGetTickCount() - start < BCS_DISPATCH_TIMEOUT) {
+        status_t* status = bcs_request_status(belt, ucan_queue, &tmp_message);
+        if(status != NULL) {
+            if(status->lightbarrier) {
+                block_seen = true;
+            } else if(block_seen) {
+                return true;
+            }
+        }
+        vTaskDelayUntil(&last_request, BCS_STATUS_PERIOD);
+    }
+    return false;
+}
+
+/**
+ * @brief       Lets the dispatcher push the block at the end of its belt onto a target. Without feedback, the light barrier decides:
+ *              a free end means the block is gone, a block still at the end gets the command again (up to \ref BCS_SEND_RETRIES times).
+ * @type        static
+ * @param[in]   belt            The belt with the dispatcher
+ * @param[in]   ucan_queue      The queue to receive the CAN data of the belt from
+ * @param[in]   target          The index of the target belt in the dispatcher structure
+ * @return      true if the block left the belt, false if it is still there or the belt does not answer
+ **/
+static bool bcs_dispatch(belt_id_t belt, QueueHandle_t ucan_queue, uint8_t target)
+{
+    const topology_dispatcher_t* dispatcher = topology_belts[belt].dispatcher;
+    CARME_CAN_MESSAGE tmp_message;
+
+    for(uint8_t attempt = 1; attempt <= BCS_SEND_RETRIES; attempt++) {
+        if(bcs_send_dispatcher(dispatcher,dispatcher->cmd_move[target]) && bcs_await_dispatched(belt,ucan_queue)) {
+            return true;
+        }
+        status_t* status = bcs_request_status(belt, ucan_queue, &tmp_message);
+        if(status == NULL) {
+            break;
+        }
+        if(!status->lightbarrier) {
+            LOG(BCS, LOG_WARN, DISPLAY_NEWLINE,"Dispatcher: no feedback, but the end is free");
+            return true;
+        }
+        LOG(BCS, LOG_WARN, DISPLAY_NEWLINE,"Dispatcher: block still at the end, repeating (%u)",attempt);
+    }
+    LOG(BCS, LOG_ERROR, DISPLAY_NEWLINE,"Dispatcher: block not pushed");
+    return false;
+}
+
+/**
+ * @brief       Waits until a block is detected on the specified belt.
+ *              The next status is requested as soon as the previous one has arrived (but at most every \ref BCS_STATUS_PERIOD ticks),
+ *              so the block is found one bus round trip after the belt detected it.
  * @type        static
  * @param[in]   belt            The belt to wait for a block
  * @param[in]   queue           The queue to receive the CAN data from
  * @param[out]  tmp_message     The buffer where to store the temporary CAN messages
+ * @param[in]   wait_forever    Do not abort after \ref BCS_DETECTION_TIMEOUT (the block is placed by hand)
  * @return      A pointer to the status message that was received (valid as long as tmp_message is valid)
  **/
-static status_t* bcs_await_block(enum belt_select belt, QueueHandle_t ucan_queue, CARME_CAN_MESSAGE* tmp_message)
+static status_t* bcs_await_block(belt_id_t belt, QueueHandle_t ucan_queue, CARME_CAN_MESSAGE* tmp_message, bool wait_forever)
 {
-    uint8_t statR = display_log(DISPLAY_NEWLINE,"Waiting on block...");
-    uint16_t wait_count = 0;
+    uint8_t statR = LOG(BCS, LOG_DEBUG, DISPLAY_NEWLINE,"Waiting on block...");
+    uint16_t request_count = 0;
+    uint8_t last_detection = 0xFF;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t last_request = start;
     status_t* status;
 
     /* Wait until the block is fully detected */
     while(true) {
 
-        /* Request status */
-        bcs_send_msg(&msg_status_request,belt);
-
-        /* Wait on status response */
-        do {
-            if(xQueueReceive(ucan_queue,tmp_message,4000)==pdFALSE) {
-                wait_count++;
-                display_log(statR,"Waiting on block (%u): timeout", wait_count);
-            }
-        } while(tmp_message->id != belt+msg_status_response_id); //repeat until correct response message arrives
-
-        status = (status_t*)&(tmp_message->data);
-        wait_count++;
-
-        /* Block detected */
-        if(status->detection == 3) {
-            display_log(statR,"Waiting on block. Found! position %04x location %d", status->position, status->location );
+        /* Request status and wait on the response */
+        status = bcs_request_status(belt, ucan_queue, tmp_message);
+        request_count++;
+        if(status == NULL) {
+            LOG(BCS, LOG_WARN, statR,"Waiting on block (%u): timeout", request_count);
+        } else if(status->detection == 3) { /* Block detected */
+            dashboard_belt_update(belt, dashboard_belt_ready, status->position);
+            LOG(BCS, LOG_INFO, statR,"Waiting on block. Found! position %04x location %d", status->position, status->location );
             return status;
+        } else {
+            if(status->detection != last_detection) { //only log changes, not every request
+                last_detection = status->detection;
+                LOG(BCS, LOG_DEBUG, statR,"Waiting on block (%u): detection: %u pos: %04x",request_count,status->detection, status->position);
+            }
+            dashboard_belt_update(belt, dashboard_belt_moving, status->position);
         }
 
-        display_log(statR,"Waiting on block (%u): detection: %u pos: %04x",wait_count,status->detection, status->position);
-        vTaskDelay(100);
-
         /* Timeout */
-        if(wait_count >= 100) {
+        if(!wait_forever && xTaskGetTickCount() - start >= BCS_DETECTION_TIMEOUT) {
             bcs_send_msg(&msg_cmd_done,belt);
-            display_log(statR,"Waiting on block (%u): Aborted",wait_count);
+            LOG(BCS, LOG_ERROR, statR,"Waiting on block (%u): Aborted",request_count);
+            dashboard_belt_update(belt, dashboard_belt_error, 0);
             return NULL;
         }
+
+        vTaskDelayUntil(&last_request, BCS_STATUS_PERIOD);
     }
 }
 
 
 
 /**
- * @brief       Prepares a block drop operation to a specific belt
+ * @brief       Prepares a block drop operation to a specific belt. Waits until the drop zone of the belt is free.
  * @type        global
  * @param[in]   belt    The belt a block will be dropped to
  * @return      None
  **/
-void bcs_prepare_drop(enum belt_select belt)
+void bcs_prepare_drop(belt_id_t belt)
 {
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    bcs_claim_checked(slots, BCS_EV_DROP_FREE);
+    taskENTER_CRITICAL();
+    slots->blocks++;
+    taskEXIT_CRITICAL();
+}
 
-    switch(belt) {
-    case belt_left:
-        xSemaphoreTake(bcs_left_free_semaphore,portMAX_DELAY);
-        break;
-    case belt_right:
-        xSemaphoreTake(bcs_right_free_semaphore,portMAX_DELAY);
-        break;
-    case belt_mid:
-        xSemaphoreTake(bcs_mid_free_semaphore,portMAX_DELAY);
-        break;
-
-    }
+/**
+ * @brief       Cancels a drop prepared with \ref bcs_prepare_drop, the block was not dropped
+ * @type        static
+ * @param[in]   belt    The belt the block was going to be dropped to
+ * @return      None
+ **/
+static void bcs_cancel_drop(belt_id_t belt)
+{
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    taskENTER_CRITICAL();
+    slots->blocks--;
+    taskEXIT_CRITICAL();
+    xEventGroupSetBits(slots->events, BCS_EV_DROP_FREE);
 }
 
 /**
@@ -198,74 +488,195 @@ void bcs_prepare_drop(enum belt_select belt)
  * @param[in]   belt    The belt the block has been dropped onto
  * @return      None
  **/
-void bcs_signal_dropped(enum belt_select belt)
+void bcs_signal_dropped(belt_id_t belt)
 {
-    switch(belt) {
-    case belt_left:
-        xSemaphoreGive(bcs_left_start_semaphore);
-        break;
-    case belt_right:
-        xSemaphoreGive(bcs_right_start_semaphore);
-        break;
-    case belt_mid:
-        xSemaphoreGive(bcs_mid_start_semaphore);
-        break;
+    xEventGroupSetBits(bcs_get_belt(belt)->events, BCS_EV_DROPPED);
+}
 
+/**
+ * @brief       Releases the end zone of a belt, its block left the belt
+ * @type        static
+ * @param[in]   belt    The belt that is now free
+ * @param[in]   carried The block is in the gripper of the arm now
+ * @return      None
+ **/
+static void bcs_free_end(belt_id_t belt, bool carried)
+{
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    taskENTER_CRITICAL();
+    if(slots->blocks > 0) {
+        slots->blocks--;
+    }
+    if(carried) {
+        slots->carried++;
     }
+    taskEXIT_CRITICAL();
+    xEventGroupSetBits(slots->events, BCS_EV_END_FREE);
 }
 
 /**
- * @brief       Signal that a block has been removed from a belt and the belt is free again
+ * @brief       Signal that the arm picked the block up from the end of a belt and the end zone is free again
  * @type        global
  * @param[in]   belt    The belt that is now free
  * @return      None
  **/
-void bcs_signal_band_free(enum belt_select belt)
+void bcs_signal_band_free(belt_id_t belt)
 {
-    switch(belt) {
-    case belt_left:
-        xSemaphoreGive(bcs_left_free_semaphore);
-        break;
-    case belt_right:
-        xSemaphoreGive(bcs_right_free_semaphore);
-        break;
-    case belt_mid:
-        xSemaphoreGive(bcs_mid_free_semaphore);
-        break;
+    bcs_free_end(belt, true);
+}
 
+/**
+ * @brief       Signal that the arm dropped the block it took from a belt, see \ref bcs_signal_band_free
+ * @type        global
+ * @param[in]   belt    The belt the block was taken from
+ * @return      None
+ **/
+void bcs_signal_delivered(belt_id_t belt)
+{
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    taskENTER_CRITICAL();
+    if(slots->carried > 0) {
+        slots->carried--;
     }
+    taskEXIT_CRITICAL();
 }
 
 /**
- * @brief       Awaits until a block has been dropped on the specific belt
- * @type        static
- * @param[in]   belt    The belt we want to wait for a block
- * @param[in]   allow_skip Whether or not we want to abort if now block is found after a timeout.
+ * @brief       Reports the progress of an arm through its waypoint cycle, for the adaptive dispatcher
+ * @type        global
+ * @param[in]   belt            The belt the arm takes its blocks from
+ * @param[in]   ticks_until_grab Predicted time until the arm grabs the next block (0: waiting on the block)
+ * @param[in]   ticks_per_cycle  Predicted time of a full cycle of the arm
  * @return      None
  **/
-static void bcs_await_drop(enum belt_select belt, bool allow_skip)
+void bcs_signal_arm_progress(belt_id_t belt, TickType_t ticks_until_grab, TickType_t ticks_per_cycle)
 {
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    slots->arm_ticks_until_grab = ticks_until_grab;
+    slots->arm_ticks_per_cycle = ticks_per_cycle;
+}
 
-    switch(belt) {
-    case belt_left:
-        xSemaphoreTake(bcs_left_start_semaphore,portMAX_DELAY);
-        break;
-    case belt_right:
-        xSemaphoreTake(bcs_right_start_semaphore,portMAX_DELAY);
-        break;
-    case belt_mid:
-        if(allow_skip) {
-            xSemaphoreTake(bcs_mid_start_semaphore,2000); //try to aquire mutex anyway, in case it was already there
-            //if mutex could not be taken => go on (skipping is allowed)
-        } else {
-            xSemaphoreTake(bcs_mid_start_semaphore,portMAX_DELAY);
-        }
-        break;
+/**
+ * @brief       Estimates how long a new block would wait on a target belt, in ticks.
+ *              Every block already on the belt costs a full arm cycle, plus the way of the arm back to the belt.
+ * @type        static
+ * @param[in]   belt    The target belt
+ * @return      Estimated time until the arm would grab a new block
+ **/
+static uint32_t bcs_side_load(belt_id_t belt)
+{
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    uint32_t load = slots->blocks * slots->arm_ticks_per_cycle + slots->arm_ticks_until_grab;
+    if(!(xEventGroupGetBits(slots->events) & BCS_EV_DROP_FREE)) { //dispatcher would have to wait on the drop zone
+        load += slots->arm_ticks_per_cycle;
+    }
+    return load;
+}
+
+/**
+ * @brief       Checks whether a side is full: a block in the drop zone, one at the end and one in the gripper of the arm.
+ *              Its drop zone is only freed once the arm dropped its block onto the mid belt. If the drop zone there is occupied
+ *              as well, a dispatcher waiting on the side deadlocks the cell; it must not wait on a full side at all, the other arm
+ *              could occupy that drop zone meanwhile.
+ * @type        static
+ * @param[in]   belt    The target belt
+ * @return      true if the side is full
+ **/
+static bool bcs_side_full(belt_id_t belt)
+{
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    return slots->blocks + slots->carried >= BCS_SIDE_SLOTS;
+}
 
+/**
+ * @brief       Makes sure the dispatcher does not wait on a full side (see \ref bcs_side_full). Another target is taken instead,
+ *              with the manual policy only once the drop zone of the dispatcher belt is occupied (before, the arm of the side
+ *              can still drop its block). Without such a target, the sides are checked again until one has room.
+ * @type        static
+ * @param[in]   belt        The belt with the dispatcher
+ * @param[in]   policy      The policy of the block
+ * @param[in]   target      The index of the chosen target in the dispatcher structure
+ * @return      The index of a target which is not full
+ **/
+static uint8_t bcs_avoid_full_side(belt_id_t belt, enum bcs_policy policy, uint8_t target)
+{
+    const topology_dispatcher_t* dispatcher = topology_belts[belt].dispatcher;
+
+    while(bcs_side_full(dispatcher->targets[target])) {
+        if(policy != bcs_policy_manual || bcs_get_belt(belt)->blocks > 1) {
+            for(uint8_t t = 0; t < dispatcher->target_count; t++) {
+                if(!bcs_side_full(dispatcher->targets[t])) {
+                    LOG(BCS, LOG_INFO, DISPLAY_NEWLINE,"%s is full, moving to %s",topology_belts[dispatcher->targets[target]].name,
+                        topology_belts[dispatcher->targets[t]].name);
+                    bcs_send_dispatcher(dispatcher,dispatcher->cmd_start[t]);
+                    dashboard_dispatcher_update(t == 0 ? -1 : 1);
+                    return t;
+                }
+            }
+        }
+        vTaskDelay(BCS_FULL_POLL);
     }
+    return target;
+}
+
+/**
+ * @brief       Reads the DIP switches
+ * @type        static
+ * @return      One bit per switch, see switches.h
+ **/
+static uint8_t bcs_switches()
+{
+    uint8_t switch_data;
+    CARME_IO1_SWITCH_Get(&switch_data);
+    return switch_data;
+}
 
+/**
+ * @brief       Reads the dispatcher policy from the DIP switches
+ * @type        static
+ * @return      The selected policy
+ **/
+static enum bcs_policy bcs_select_policy()
+{
+    if(bcs_switches()&SWITCH_MANUAL) {
+        return bcs_policy_manual;
+    }
+    if(bcs_switches()&SWITCH_ADAPTIVE) {
+        return bcs_policy_adaptive;
+    }
+    return bcs_policy_alternate;
 }
 
+/**
+ * @brief       Chooses the target belt for the next block
+ * @type        static
+ * @param[in]   policy      The policy to apply
+ * @param[in]   dispatcher  The dispatcher which pushes the block
+ * @param[in]   next        Target of the alternating policy, used on a tie as well
+ * @return      Index of the target in the dispatcher structure
+ **/
+static uint8_t bcs_choose_target(enum bcs_policy policy, const topology_dispatcher_t* dispatcher, uint8_t next)
+{
+    switch(policy) {
+    case bcs_policy_manual:
+        return ((bcs_switches()&SWITCH_DIRECTION) ? 0 : 1) % dispatcher->target_count; //read direction from switch
+    case bcs_policy_adaptive: {
+        uint8_t best = next;
+        uint32_t best_load = bcs_side_load(dispatcher->targets[next]);
+        for(uint8_t t = 0; t < dispatcher->target_count; t++) {
+            uint32_t load = bcs_side_load(dispatcher->targets[t]);
+            LOG(BCS, LOG_DEBUG, DISPLAY_NEWLINE,"Load %s %lu ms",topology_belts[dispatcher->targets[t]].name,load * portTICK_PERIOD_MS);
+            if(load < best_load) {
+                best = t;
+                best_load = load;
+            }
+        }
+        return best;
+    }
+    default:
+        return next;
+    }
+}
 
 /**
  * @brief       Instructs the system that we want to grab a block from the bcs
@@ -273,155 +684,385 @@ static void bcs_await_drop(enum belt_select belt, bool allow_skip)
  * @param[in]   belt    The belt we want to grab a block from
  * @return      Position of the block (relative to the center of the band)
  **/
-int8_t bcs_grab(enum belt_select belt)
+int8_t bcs_grab(belt_id_t belt)
 {
-    int8_t pos;
-    if(belt == belt_left) {
-        xQueueReceive(bcs_left_end_queue,&pos,portMAX_DELAY);
-    } else if(belt == belt_right) {
-        xQueueReceive(bcs_right_end_queue,&pos,portMAX_DELAY);
-    }
-    return pos;
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    bcs_claim_checked(slots, BCS_EV_END_READY);
+    return slots->location;
 }
 
 /**
- * @brief       bcs main task
- * @type        static
- * @param[in]   pv_data     The belt we want to run the task for. Pass a value of belt_select here
- * @return      None
+ * @brief       Waits until the next block is detected on a belt, while it still moves to the end of the belt.
+ *              The block is grabbed with \ref bcs_grab once it is at the end.
+ * @type        global
+ * @param[in]   belt    The belt we want to grab a block from
+ * @return      Position of the block (relative to the center of the band)
  **/
-static void bcs_task(void *pv_data)
+int8_t bcs_expect(belt_id_t belt)
 {
-    enum belt_select belt = (enum belt_select)pv_data;
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    bcs_claim_checked(slots, BCS_EV_DETECTED);
+    return slots->location;
+}
 
-    QueueHandle_t ucan_queue;
+/**
+ * @brief       Waits until the expected block (see \ref bcs_expect) reaches the end of the belt in lead ticks.
+ *              The arrival is predicted from the detection and the travel time of the previous blocks,
+ *              the wait ends early if the block is at the end already. Until a travel time was measured
+ *              it waits until the block is at the end.
+ * @type        global
+ * @param[in]   belt    The belt we want to grab a block from
+ * @param[in]   lead    Time in ticks the caller needs to get ready for the block
+ * @return      None
+ **/
+void bcs_await_arrival(belt_id_t belt, TickType_t lead)
+{
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    TickType_t travel = slots->travel;
+    if(travel == 0) { //no prediction yet, the block is awaited at the end
+        travel = BCS_END_TIMEOUT;
+        lead = 0;
+    }
+    int32_t wait = (int32_t)(slots->detected_at + travel - lead - xTaskGetTickCount());
 
-    switch(belt) {
-    case belt_left:
-        ucan_queue = ucan_queue_left;
-        break;
-    case belt_right:
-        ucan_queue = ucan_queue_right;
-        break;
-    case belt_mid:
-        ucan_queue = ucan_queue_mid;
-        break;
+    if(wait > 0) {
+        xEventGroupWaitBits(slots->events, BCS_EV_END_READY, pdFALSE, pdTRUE, wait); //not claimed, see bcs_grab
+    }
+}
 
+/**
+ * @brief       Announces the block of a belt: the dispatcher is moved out of its way, or the arm starts its approach
+ *              (see \ref bcs_await_arrival)
+ * @type        static
+ * @param[in]   belt        The belt of the block
+ * @param[in]   status      The status reported with the detection
+ * @param[in]   policy      The policy for the block (belts with a dispatcher only)
+ * @param[in]   next        The target of the alternating policy (belts with a dispatcher only)
+ * @return      The index of the target belt in the dispatcher structure (0 for belts without dispatcher)
+ **/
+static uint8_t bcs_announce(belt_id_t belt, const status_t* status, enum bcs_policy policy, uint8_t next)
+{
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    const topology_dispatcher_t* dispatcher = topology_belts[belt].dispatcher;
+
+    if(dispatcher == NULL) {
+        slots->location = status->location;
+        slots->detected_at = xTaskGetTickCount();
+        xEventGroupSetBits(slots->events, BCS_EV_DETECTED);
+        return 0;
     }
 
+    uint8_t target = bcs_choose_target(policy, dispatcher, next);
+    LOG(BCS, LOG_INFO, DISPLAY_NEWLINE,"Making dispatcher ready for moving to %s",topology_belts[dispatcher->targets[target]].name);
+    bcs_send_dispatcher(dispatcher,dispatcher->cmd_start[target]);
+    dashboard_dispatcher_update(target == 0 ? -1 : 1);
+    return target;
+}
+
+/**
+ * @brief       Resyncs a belt after a failed handoff step, e.g. a lost start command or a missed detection. The belt is stopped and,
+ *              unless the light barrier already sees a block at the end, run to its stop position, so a block anywhere on the belt
+ *              (also one in the drop zone, which no sensor sees) ends up at the end.
+ *              With \ref SWITCH_RECOVERY_ACK the belt waits until the operator checked it and pressed \ref BCS_RECOVERY_BUTTON.
+ * @type        static
+ * @param[in]   belt        The belt to resync
+ * @param[in]   ucan_queue  The queue to receive the CAN data from
+ * @param[out]  tmp_message The buffer where to store the temporary CAN messages
+ * @return      A pointer to the status of the block stopped at the end (in tmp_message), or NULL if the belt is empty
+ **/
+static status_t* bcs_recover(belt_id_t belt, QueueHandle_t ucan_queue, CARME_CAN_MESSAGE* tmp_message)
+{
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    uint8_t button_data = 0;
+    status_t* status;
 
-    //only for mid task
-    bool move_left = true; //whether the dispatcher should move left or right
-    uint8_t mid_start_without_mutex_count = 0; //The number of times we started the mid band without awaiting the mutex
+    slots->recoveries++;
+    LOG(BCS, LOG_ERROR, DISPLAY_NEWLINE,"Handoff failed, recovering (%u)",slots->recoveries);
+    bcs_send_msg(&msg_cmd_stop,belt);
+    while(xQueueReceive(ucan_queue,tmp_message,0) == pdTRUE); //drop late status responses
 
+    if(bcs_switches()&SWITCH_RECOVERY_ACK) {
+        LOG(BCS, LOG_ERROR, DISPLAY_NEWLINE,"Check belt %s, then press T3",topology_belts[belt].name);
+        do {
+            vTaskDelay(BCS_BUTTON_POLL);
+            CARME_IO1_BUTTON_Get(&button_data);
+        } while(!(button_data & BCS_RECOVERY_BUTTON));
+    }
 
-    while(true) {
-        //----- Step 0: Reset band
-        bcs_send_msg(&msg_cmd_reset,belt);
-        display_log(DISPLAY_NEWLINE,"reset band");
-
-        //----- Step 1: Wait on a block (take semaphore), before we start the band ------------------
-        bool allow_skip = false;
-        if(belt == belt_mid) {
-            if(mid_start_without_mutex_count < MAX_BLOCK_COUNT) { //we are in the init phase
-                mid_start_without_mutex_count++;
-                allow_skip = true;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t last_request = start;
+    while(xTaskGetTickCount() - start < BCS_SWEEP_TIMEOUT) {
+        status = bcs_request_status(belt,ucan_queue,tmp_message);
+        if(status != NULL) {
+            if(status->lightbarrier && !status->engine) {
+                LOG(BCS, LOG_WARN, DISPLAY_NEWLINE,"Block found at the end (pos %u)",status->position);
+                dashboard_belt_update(belt, dashboard_belt_ready, status->position);
+                return status;
+            }
+            if(!status->engine) { //not started yet, or the start was lost
+                bcs_send_msg(&msg_cmd_start,belt);
+                bcs_send_msg(&msg_cmd_stoppos,belt);
+                dashboard_belt_update(belt, dashboard_belt_moving, 0);
             }
-
-            display_log(DISPLAY_NEWLINE,"Reset dispatcher");
-            bcs_send_msg(&msg_cmd_disp_initial_pos,0);
         }
+        vTaskDelayUntil(&last_request, BCS_STATUS_PERIOD);
+    }
+
+    bcs_send_msg(&msg_cmd_stop,belt);
+    LOG(BCS, LOG_ERROR, DISPLAY_NEWLINE,"Belt %s is empty, block lost",topology_belts[belt].name);
+    return NULL;
+}
+
+/**
+ * @brief       bcs main task, a state machine per belt (see \ref bcs_state)
+ * @type        static
+ * @param[in]   pv_data     The belt we want to run the task for. Pass the index of the belt in topology_belts here
+ * @return      None
+ **/
+static void bcs_task(void *pv_data)
+{
+    belt_id_t belt = (belt_id_t)(uintptr_t)pv_data;
 
-        bcs_await_drop(belt,allow_skip);
+    bcs_belt_t* slots = bcs_get_belt(belt);
+    QueueHandle_t ucan_queue = slots->ucan_queue;
+    const topology_dispatcher_t* dispatcher = topology_belts[belt].dispatcher;
 
+    enum bcs_state state = bcs_state_reset;
+    TickType_t stage_start = xTaskGetTickCount(); //start of the current state, for the metrics
+    TickType_t lost_since = 0; //start of the failed handoff step
+    CARME_CAN_MESSAGE tmp_message;
+    status_t* status;
+    //progress of the current block, to resync the handoff events in the recovery
+    bool loaded = false; //the block was dropped (or placed) on the belt
+    bool end_claimed = false; //the end zone was claimed for the block
+    bool announced = false; //the block was announced to the arm or the dispatcher
+    bool drop_released = false; //the drop zone was released for the next block
+
+    //only for belts with a dispatcher
+    uint8_t target = 0; //index of the target belt in the dispatcher structure
+    uint8_t next_target = 0; //target of the alternating policy
+    TickType_t last_dispatch = 0; //time when the previous block left the band
+    enum bcs_policy policy = bcs_policy_alternate; //policy of the current block
+    bcs_policy_stats_t policy_stats[bcs_policy_count] = {{0}}; //throughput per policy
+    //only for feeder belts
+    uint8_t hand_placed = topology_belts[belt].feeder ? MAX_BLOCK_COUNT : 0; //number of blocks which are still placed by hand
+    bool placed_by_hand = false; //whether the current block was placed by hand
 
-        //----- Step 2: Start the band, and wait till we detect the block
-        bcs_send_msg(&msg_cmd_start,belt);
-        bcs_send_msg(&msg_cmd_stoppos,belt);
-        display_log(DISPLAY_NEWLINE,"start band");
 
-        CARME_CAN_MESSAGE tmp_message;
-        status_t* status = bcs_await_block(belt,ucan_queue,&tmp_message);
-        if(status==NULL) { //timeout
-            while(true);
-            //TODO: Listen on button press
-        }
+    while(true) {
+        enum bcs_state next = state;
+
+        switch(state) {
+        case bcs_state_reset:
+            LOG(BCS, LOG_INFO, DISPLAY_NEWLINE,"reset band");
+            dashboard_belt_update(belt, dashboard_belt_idle, 0);
+            if(!bcs_send_msg(&msg_cmd_reset,belt)) { //the belt is not reachable, the next block waits until it is
+                vTaskDelay(BCS_RESET_RETRY);
+                break;
+            }
 
-        //----- Step 3 (only mid band): Move the dispatcher so we don't interfere with the coming block
-        if(belt== belt_mid) {
-            if(*SWITCH&0x01) { //Manual Direction selection
-                move_left = *SWITCH&0x02; //read direction from switch
+            if(dispatcher != NULL) {
+                LOG(BCS, LOG_INFO, DISPLAY_NEWLINE,"Reset dispatcher");
+                if(!bcs_send_dispatcher(dispatcher,dispatcher->cmd_initial)) { //it could be in the way of the next block
+                    vTaskDelay(BCS_RESET_RETRY);
+                    break;
+                }
+                dashboard_dispatcher_update(0);
             }
-            display_log(DISPLAY_NEWLINE,"Making dispatcher ready for moving %s",move_left ? "left" : "right");
-            bcs_send_msg(move_left ? &msg_cmd_disp_start_left : &msg_cmd_disp_start_right,0);
-        }
-        vTaskDelay(2000); //let block move to the end of the band
+            loaded = end_claimed = announced = drop_released = false;
+            next = bcs_state_await_drop;
+            break;
 
+        case bcs_state_await_drop:
+            dashboard_belt_update(belt, dashboard_belt_waiting, 0);
+            placed_by_hand = hand_placed > 0;
+            if(placed_by_hand) { //init phase: the detection waits until the block is placed
+                if(!bcs_claim(slots, BCS_EV_DROPPED, 0)) { //a block dropped by an arm is taken instead, the placed one follows
+                    hand_placed--;
+                }
+            } else if(!bcs_claim_or_check(slots, BCS_EV_DROPPED)) {
+                lost_since = xTaskGetTickCount();
+                next = bcs_state_recovery;
+                break;
+            }
+            loaded = true;
+            next = bcs_state_start;
+            break;
 
-        //----- Step 4: Mark the block ready for further processing (give semaphore) and optionally move the dispatcher (only mid band).
-        switch(belt) {
-        case belt_left:
-            //bcs_prepare_pickup(belt_left)
-            xQueueSend(bcs_left_end_queue,&(status->location),portMAX_DELAY);
+        case bcs_state_start:
+            if(!bcs_claim_or_check(slots, BCS_EV_END_FREE)) { //the previous block has to be removed from the end zone
+                lost_since = xTaskGetTickCount();
+                next = bcs_state_recovery;
+                break;
+            }
+            end_claimed = true;
+            stage_start = metrics_record(METRICS_BELT(belt), metrics_bcs_await_end, stage_start);
+            if(!bcs_send_msg(&msg_cmd_start,belt) || !bcs_send_msg(&msg_cmd_stoppos,belt)) { //the recovery finds the block wherever it is
+                lost_since = xTaskGetTickCount();
+                next = bcs_state_recovery;
+                break;
+            }
+            LOG(BCS, LOG_INFO, DISPLAY_NEWLINE,"start band");
+            dashboard_belt_update(belt, dashboard_belt_moving, 0);
+            next = bcs_state_detect;
             break;
-        case belt_right:
-            //bcs_prepare_pickup(belt_right)
-            xQueueSend(bcs_right_end_queue,&(status->location),portMAX_DELAY);
+
+        case bcs_state_detect:
+            status = bcs_await_block(belt,ucan_queue,&tmp_message,placed_by_hand);
+            if(status==NULL) { //timeout
+                lost_since = stage_start;
+                next = bcs_state_recovery;
+                break;
+            }
+            if(placed_by_hand && bcs_claim(slots, BCS_EV_DROPPED, 0)) { //an arm dropped a block while waiting: either one was found, the other one is awaited without timeout as well
+                hand_placed++;
+            }
+
+            //Move the dispatcher so we don't interfere with the coming block, or let the arm start its approach
+            policy = bcs_select_policy();
+            target = bcs_announce(belt, status, policy, next_target);
+            announced = true;
+            if(!bcs_await_end(belt,ucan_queue)) { //the belt may still run, the recovery stops it and finds the block
+                LOG(BCS, LOG_WARN, DISPLAY_NEWLINE,"No stop at the end reported");
+                lost_since = stage_start;
+                next = bcs_state_recovery;
+                break;
+            }
+            if(dispatcher == NULL) {
+                TickType_t travel = xTaskGetTickCount() - slots->detected_at;
+                slots->travel = slots->travel == 0 ? travel : (3 * slots->travel + travel) / 4; //smoothed over a few blocks
+            }
+            xEventGroupSetBits(slots->events, BCS_EV_DROP_FREE); //the next block can be dropped while this one waits at the end
+            drop_released = true;
+            next = bcs_state_dispatch;
             break;
-        case belt_mid:
-            bcs_prepare_drop(move_left ? belt_left : belt_right);
 
-            display_log(DISPLAY_NEWLINE,"Dispatcher moves %s",move_left ? "left" : "right");
-            bcs_send_msg(move_left ? &msg_cmd_disp_move_left : &msg_cmd_disp_move_right,0);
-            vTaskDelay(1000); //let dispatcher move block away
+        case bcs_state_dispatch:
+            if(dispatcher == NULL) {
+                xEventGroupSetBits(slots->events, BCS_EV_END_READY); //the arm signals the free end zone after the pickup
+            } else {
+                target = bcs_avoid_full_side(belt, policy, target);
+                belt_id_t target_belt = dispatcher->targets[target];
+                bcs_prepare_drop(target_belt);
+                stage_start = metrics_record(METRICS_BELT(belt), metrics_bcs_await_target, stage_start);
+
+                LOG(BCS, LOG_INFO, DISPLAY_NEWLINE,"Dispatcher moves to %s",topology_belts[target_belt].name);
+                if(!bcs_dispatch(belt,ucan_queue,target)) { //the drop zone of the target stays empty, the recovery checks the end
+                    bcs_cancel_drop(target_belt);
+                    lost_since = xTaskGetTickCount();
+                    next = bcs_state_recovery;
+                    break;
+                }
+
+                bcs_signal_dropped(target_belt);
+                next_target = (target + 1) % dispatcher->target_count;
+
+                /* Cycle time: time between two blocks leaving the band */
+                TickType_t now = xTaskGetTickCount();
+                if(last_dispatch != 0) {
+                    bcs_policy_stats_t* stats = &policy_stats[policy];
+                    stats->cycle_sum += now - last_dispatch;
+                    stats->blocks++;
+                    LOG(BCS, LOG_INFO, DISPLAY_NEWLINE,"Cycle time %lu ms (%s: avg %lu ms, %lu blocks/min over %u blocks)",
+                        (now - last_dispatch) * portTICK_PERIOD_MS, bcs_policy_names[policy],
+                        stats->cycle_sum / stats->blocks * portTICK_PERIOD_MS,
+                        60000UL * stats->blocks / (stats->cycle_sum * portTICK_PERIOD_MS), stats->blocks);
+                }
+                last_dispatch = now;
+            }
+            next = bcs_state_done;
+            break;
 
-            bcs_signal_dropped(move_left ? belt_left : belt_right);
-            move_left = ! move_left;
+        case bcs_state_done:
+            bcs_send_msg(&msg_cmd_done,belt); //not needed for the next block, the belt is reset anyway
+            if(dispatcher != NULL) {
+                bcs_free_end(belt, false); //block was pushed away by the dispatcher
+            }
+            next = bcs_state_reset;
             break;
 
+        case bcs_state_recovery:
+            if(!loaded) { //nothing dropped: only a block nobody knows about is taken, if both zones are free for it
+                status = bcs_request_status(belt,ucan_queue,&tmp_message);
+                if(status == NULL || !(status->lightbarrier || status->position != 0)) {
+                    next = bcs_state_await_drop;
+                    break;
+                }
+                if(!bcs_claim(slots, BCS_EV_DROP_FREE, 0)) { //a drop is in progress, its block is seen
+                    next = bcs_state_await_drop;
+                    break;
+                }
+                if(!bcs_claim(slots, BCS_EV_END_FREE, 0)) { //the previous block still waits at the end
+                    xEventGroupSetBits(slots->events, BCS_EV_DROP_FREE);
+                    next = bcs_state_await_drop;
+                    break;
+                }
+                LOG(BCS, LOG_ERROR, DISPLAY_NEWLINE,"Unknown block on the belt, taking it");
+                taskENTER_CRITICAL();
+                slots->blocks++;
+                taskEXIT_CRITICAL();
+                loaded = end_claimed = true;
+            } else if(!end_claimed) { //the previous block still waits at the end, the belt must not run
+                next = bcs_state_start;
+                break;
+            }
 
-        }
+            status = bcs_recover(belt,ucan_queue,&tmp_message);
+            if(status != NULL) { //continue the handoff of the block from the end of the belt
+                if(!announced) {
+                    policy = bcs_select_policy();
+                    target = bcs_announce(belt, status, policy, next_target);
+                    announced = true;
+                }
+                if(!drop_released) {
+                    xEventGroupSetBits(slots->events, BCS_EV_DROP_FREE);
+                    drop_released = true;
+                }
+                next = bcs_state_dispatch;
+            } else { //the block is lost, the line continues with one block less
+                if(!drop_released) {
+                    xEventGroupSetBits(slots->events, BCS_EV_DROP_FREE);
+                }
+                if(dispatcher == NULL && announced && !bcs_claim(slots, BCS_EV_DETECTED, 0)) { //the arm is on its way: it finds the end empty and frees it
+                    xEventGroupSetBits(slots->events, BCS_EV_END_READY);
+                } else {
+                    bcs_free_end(belt, false);
+                }
+                next = bcs_state_reset;
+            }
 
-        //---- Step 5: Tell the band that we're finished
-        bcs_send_msg(&msg_cmd_done,belt);
-        if(belt == belt_mid) {
-            bcs_signal_band_free(belt_mid);
+            slots->downtime += xTaskGetTickCount() - lost_since;
+            LOG(BCS, LOG_WARN, DISPLAY_NEWLINE,"Recovered after %lu ms (%u times, %lu s down)",
+                (xTaskGetTickCount() - lost_since) * portTICK_PERIOD_MS, slots->recoveries,
+                slots->downtime * portTICK_PERIOD_MS / 1000);
+            break;
         }
+
+        stage_start = metrics_record(METRICS_BELT(belt), state, stage_start);
+        state = next;
     }
 }
 
 /**
- * @brief       Initializes the belt conveyer system and starts the belt tasks
+ * @brief       Initializes the belt conveyer system and starts one task per belt of the topology
  * @type        global
  * @return      None
  **/
 void bcs_init()
 {
-    bcs_left_start_semaphore = xSemaphoreCreateBinary();
-    bcs_right_start_semaphore = xSemaphoreCreateBinary();
-    bcs_mid_start_semaphore = xSemaphoreCreateBinary();
-
-    bcs_left_free_semaphore = xSemaphoreCreateBinary();
-    bcs_mid_free_semaphore = xSemaphoreCreateBinary();
-    bcs_right_free_semaphore = xSemaphoreCreateBinary();
-    xSemaphoreGive(bcs_left_free_semaphore);
-    //xSemaphoreGive(bcs_mid_free_semaphore);
-    xSemaphoreGive(bcs_right_free_semaphore);
-
-    bcs_left_end_queue = xQueueCreate(1,sizeof(int8_t));
-    bcs_right_end_queue = xQueueCreate(1,sizeof(int8_t));
-
-    xTaskCreate(bcs_task,"mid",STACKSIZE_TASK,(void*)belt_mid,PRIORITY_TASK,NULL);
-    xTaskCreate(bcs_task,"left",STACKSIZE_TASK,(void*)belt_left,PRIORITY_TASK,NULL);
-    xTaskCreate(bcs_task,"right",STACKSIZE_TASK,(void*)belt_right,PRIORITY_TASK,NULL);
-
-    ucan_queue_right = xQueueCreate(1,sizeof(CARME_CAN_MESSAGE));
-    ucan_queue_left = xQueueCreate(1,sizeof(CARME_CAN_MESSAGE));
-    ucan_queue_mid = xQueueCreate(1,sizeof(CARME_CAN_MESSAGE));
+    for(belt_id_t belt = 0; belt < topology_belt_count; belt++) {
+        bcs_belt_t* slots = &bcs_belts[belt];
+        slots->ucan_queue = xQueueCreate(1,sizeof(CARME_CAN_MESSAGE));
+        slots->events = xEventGroupCreate();
+        //the drop zone of a feeder is released by its task, once the first block (placed by hand) reached the end
+        xEventGroupSetBits(slots->events, topology_belts[belt].feeder ? BCS_EV_END_FREE : BCS_EV_END_FREE | BCS_EV_DROP_FREE);
+
+        ucan_link_message_to_queue_mask(0xFF0,topology_belts[belt].can_base,slots->ucan_queue);
+    }
 
-    ucan_link_message_to_queue_mask(0xFF0,belt_mid,ucan_queue_mid);
-    ucan_link_message_to_queue_mask(0xFF0,belt_left,ucan_queue_left);
-    ucan_link_message_to_queue_mask(0xFF0,belt_right,ucan_queue_right);
+    for(belt_id_t belt = 0; belt < topology_belt_count; belt++) {
+        xTaskCreate(bcs_task,topology_belts[belt].name,STACKSIZE_TASK,(void*)(uintptr_t)belt,PRIORITY_TASK,NULL);
+    }
 }
 
 /*@}*/
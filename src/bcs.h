@@ -1,21 +1,19 @@
 #ifndef BCS_H
 #define BCS_H
 #include <stdint.h>
-
-/**
- * @brief The belt_select enum differenciates between the different belt tasks. The members point to the base address of the can endpoints
- */
-enum belt_select {belt_left=0x110, //!< the left belt
-                  belt_mid=0x120, //!< the middle belt
-                  belt_right=0x130//!< the right belt
-                 };
+#include <FreeRTOS.h>
+#include "topology.h"
 
 
 //doc see bcs.c
-int8_t bcs_grab(enum belt_select belt);
-void bcs_prepare_drop(enum belt_select belt);
-void bcs_signal_dropped(enum belt_select belt);
-void bcs_signal_band_free(enum belt_select belt);
+int8_t bcs_grab(belt_id_t belt);
+int8_t bcs_expect(belt_id_t belt);
+void bcs_await_arrival(belt_id_t belt, TickType_t lead);
+void bcs_prepare_drop(belt_id_t belt);
+void bcs_signal_dropped(belt_id_t belt);
+void bcs_signal_band_free(belt_id_t belt);
+void bcs_signal_delivered(belt_id_t belt);
+void bcs_signal_arm_progress(belt_id_t belt, TickType_t ticks_until_grab, TickType_t ticks_per_cycle);
 void bcs_init();
 
 #endif /* BCS_H */
@@ -0,0 +1,356 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup dashboard Dashboard
+ * @brief Graphical view of the cell (belts, dispatcher, arms, airspace and throughput)
+ *
+ * The bcs and arm tasks only update the state and mark the element as dirty.
+ * The display task calls \ref dashboard_render, which redraws the dirty elements only.
+ * The layout fits the default cell of the \ref topology: the first three belts and the first two arms are shown.
+ */
+/*@{*/
+
+#include "dashboard.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <lcd.h>
+
+// -------------------- Configuration  ------------
+#define DASHBOARD_COLUMN_X(i)   (10 + (i) * 105) //!< Left edge of the column of the left (0), mid (1) and right (2) station
+#define DASHBOARD_COLUMN_W      90 //!< Width of a column
+#define DASHBOARD_CHAR_H        8 //!< Height of a text line
+
+#define DASHBOARD_ARM_Y         20 //!< Top of the arm and airspace boxes
+#define DASHBOARD_ARM_H         50 //!< Height of the arm and airspace boxes
+#define DASHBOARD_BELT_Y        100 //!< Top of the belts
+#define DASHBOARD_BELT_H        24 //!< Height of the belts
+#define DASHBOARD_BLOCK_W       16 //!< Width of a block drawn on a belt
+#define DASHBOARD_DISP_Y        140 //!< Top of the dispatcher
+#define DASHBOARD_DISP_H        16 //!< Height of the dispatcher
+#define DASHBOARD_COUNTER_Y     190 //!< Top of the throughput counters
+
+#define DASHBOARD_BELT_POS_MAX  0xB6 //!< Belt position at the end of the belt (stop position)
+#define DASHBOARD_BELTS         3 //!< Number of belts shown (left, mid, right)
+#define DASHBOARD_ARMS          2 //!< Number of arms shown (left, right)
+
+
+// ------------------ Implementation ------------------------
+
+/**
+ * @brief Elements of the dashboard, each one is redrawn independently
+ */
+enum dashboard_element {elem_belt_left, elem_belt_mid, elem_belt_right,
+                        elem_arm_left, elem_arm_right,
+                        elem_dispatcher, elem_airspace, elem_counters,
+                        elem_count
+                       };
+
+/**
+ * @brief State of the whole cell as shown on the dashboard
+ */
+typedef struct {
+    enum dashboard_belt_state belt_state[DASHBOARD_BELTS]; //!< State of the left, mid and right belt
+    uint16_t belt_position[DASHBOARD_BELTS]; //!< Block position on the left, mid and right belt
+    int8_t dispatcher; //!< Dispatcher direction (-1 left, 0 initial, 1 right)
+    uint8_t waypoint[DASHBOARD_ARMS]; //!< Current waypoint of the left and right arm
+    int8_t airspace; //!< Arm that owns the mid airspace (-1 if free)
+    uint32_t blocks[DASHBOARD_ARMS]; //!< Number of blocks moved by the left and right arm
+    TickType_t first_block; //!< Tick of the first moved block
+} dashboard_state_t;
+
+static dashboard_state_t dashboard_state = {.airspace = -1}; //!< Current state, written by the bcs and arm tasks
+static volatile uint16_t dashboard_dirty = (1 << elem_count) - 1; //!< Bitmask of elements which need to be redrawn
+
+static const LCDCOLOR belt_colors[] = { GUI_COLOR_DARK_GREY, GUI_COLOR_YELLOW, GUI_COLOR_GREEN, GUI_COLOR_CYAN, GUI_COLOR_RED }; //!< Color per \ref dashboard_belt_state
+
+
+/**
+ * @brief       Updates the displayed state of a belt
+ * @type        global
+ * @param[in]   belt        The belt to update
+ * @param[in]   state       New state of the belt
+ * @param[in]   position    Block position reported by the belt
+ * @return      None
+ **/
+void dashboard_belt_update(belt_id_t belt, enum dashboard_belt_state state, uint16_t position)
+{
+    uint8_t column = belt;
+
+    if(column >= DASHBOARD_BELTS) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    if(dashboard_state.belt_state[column] != state || dashboard_state.belt_position[column] != position) {
+        dashboard_state.belt_state[column] = state;
+        dashboard_state.belt_position[column] = position;
+        dashboard_dirty |= 1 << (elem_belt_left + column);
+    }
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief       Updates the displayed direction of the dispatcher
+ * @type        global
+ * @param[in]   direction   -1 left, 0 initial position, 1 right
+ * @return      None
+ **/
+void dashboard_dispatcher_update(int8_t direction)
+{
+    taskENTER_CRITICAL();
+    dashboard_state.dispatcher = direction;
+    dashboard_dirty |= 1 << elem_dispatcher;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief       Updates the displayed waypoint of an arm
+ * @type        global
+ * @param[in]   arm         The arm
+ * @param[in]   waypoint    Index of the waypoint the arm moves to
+ * @return      None
+ **/
+void dashboard_arm_update(arm_id_t arm, uint8_t waypoint)
+{
+    uint8_t index = arm;
+
+    if(index >= DASHBOARD_ARMS) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    dashboard_state.waypoint[index] = waypoint;
+    dashboard_dirty |= 1 << (elem_arm_left + index);
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief       Updates the displayed owner of the mid airspace
+ * @type        global
+ * @param[in]   owner   The arm which owns the airspace, -1 if free
+ * @return      None
+ **/
+void dashboard_airspace_update(int8_t owner)
+{
+    taskENTER_CRITICAL();
+    dashboard_state.airspace = owner;
+    dashboard_dirty |= 1 << elem_airspace;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief       Counts a block that was moved by an arm
+ * @type        global
+ * @param[in]   arm     The arm that dropped the block
+ * @return      None
+ **/
+void dashboard_count_block(arm_id_t arm)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    if(arm >= DASHBOARD_ARMS) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    if(dashboard_state.blocks[0] + dashboard_state.blocks[1] == 0) {
+        dashboard_state.first_block = now;
+    }
+    dashboard_state.blocks[arm]++;
+    dashboard_dirty |= 1 << elem_counters;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief       Marks all elements as dirty, e.g. after the screen was cleared
+ * @type        global
+ * @return      None
+ **/
+void dashboard_invalidate(void)
+{
+    taskENTER_CRITICAL();
+    dashboard_dirty = (1 << elem_count) - 1;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief       Draws a belt, with the block at its reported position
+ * @type        static
+ * @param[in]   column  Column of the belt
+ * @param[in]   state   Copy of the dashboard state
+ * @return      None
+ **/
+static void dashboard_draw_belt(uint8_t column, const dashboard_state_t* state)
+{
+    uint16_t x = DASHBOARD_COLUMN_X(column);
+    enum dashboard_belt_state belt_state = state->belt_state[column];
+    LCDCOLOR color = belt_colors[belt_state];
+
+    LCD_DrawRectF(x + 1, DASHBOARD_BELT_Y + 1, DASHBOARD_COLUMN_W - 2, DASHBOARD_BELT_H - 2, GUI_COLOR_BLACK);
+    LCD_DrawRect(x, DASHBOARD_BELT_Y, DASHBOARD_COLUMN_W, DASHBOARD_BELT_H, color);
+
+    if(belt_state == dashboard_belt_moving || belt_state == dashboard_belt_ready) {
+        uint16_t position = state->belt_position[column];
+        if(position > DASHBOARD_BELT_POS_MAX) {
+            position = DASHBOARD_BELT_POS_MAX;
+        }
+        uint16_t block_x = x + 2 + position * (DASHBOARD_COLUMN_W - DASHBOARD_BLOCK_W - 4) / DASHBOARD_BELT_POS_MAX;
+        LCD_DrawRectF(block_x, DASHBOARD_BELT_Y + 3, DASHBOARD_BLOCK_W, DASHBOARD_BELT_H - 6, color);
+    }
+}
+
+/**
+ * @brief       Draws an arm with its waypoint index and cycle progress
+ * @type        static
+ * @param[in]   index   0 for the left, 1 for the right arm
+ * @param[in]   state   Copy of the dashboard state
+ * @return      None
+ **/
+static void dashboard_draw_arm(uint8_t index, const dashboard_state_t* state)
+{
+    char text[16];
+    uint16_t x = DASHBOARD_COLUMN_X(index * 2);
+    uint8_t waypoint = state->waypoint[index];
+    uint8_t waypoint_count = topology_arms[index].waypoint_count;
+    uint16_t segment_w = (DASHBOARD_COLUMN_W - 4) / waypoint_count;
+
+    LCD_DrawRectF(x + 1, DASHBOARD_ARM_Y + 1, DASHBOARD_COLUMN_W - 2, DASHBOARD_ARM_H - 2, GUI_COLOR_BLACK);
+    LCD_DrawRect(x, DASHBOARD_ARM_Y, DASHBOARD_COLUMN_W, DASHBOARD_ARM_H, GUI_COLOR_LIGHT_GRAY);
+
+    LCD_SetTextColor(GUI_COLOR_WHITE);
+    LCD_DisplayStringXY(x + 4, DASHBOARD_ARM_Y + 4, topology_arms[index].name);
+    sprintf(text, "waypoint %u", waypoint);
+    LCD_DisplayStringXY(x + 4, DASHBOARD_ARM_Y + 4 + DASHBOARD_CHAR_H + 2, text);
+
+    /* One segment per waypoint, filled up to the current one */
+    for(uint8_t n = 0; n < waypoint_count; n++) {
+        LCD_DrawRectF(x + 2 + n * segment_w, DASHBOARD_ARM_Y + DASHBOARD_ARM_H - 12, segment_w - 1, 8,
+                      n <= waypoint ? GUI_COLOR_GREEN : GUI_COLOR_DARK_GREY);
+    }
+}
+
+/**
+ * @brief       Draws the dispatcher below the mid belt
+ * @type        static
+ * @param[in]   state   Copy of the dashboard state
+ * @return      None
+ **/
+static void dashboard_draw_dispatcher(const dashboard_state_t* state)
+{
+    uint16_t x = DASHBOARD_COLUMN_X(1);
+    uint16_t pusher_w = DASHBOARD_COLUMN_W / 3;
+
+    LCD_DrawRectF(x, DASHBOARD_DISP_Y, DASHBOARD_COLUMN_W, DASHBOARD_DISP_H, GUI_COLOR_BLACK);
+    LCD_DrawRect(x, DASHBOARD_DISP_Y, DASHBOARD_COLUMN_W, DASHBOARD_DISP_H, GUI_COLOR_LIGHT_GRAY);
+    LCD_DrawRectF(x + (state->dispatcher + 1) * pusher_w + 2, DASHBOARD_DISP_Y + 2, pusher_w - 4, DASHBOARD_DISP_H - 4,
+                  state->dispatcher == 0 ? GUI_COLOR_DARK_GREY : GUI_COLOR_ORANGE);
+}
+
+/**
+ * @brief       Draws the owner of the mid airspace above the mid belt
+ * @type        static
+ * @param[in]   state   Copy of the dashboard state
+ * @return      None
+ **/
+static void dashboard_draw_airspace(const dashboard_state_t* state)
+{
+    uint16_t x = DASHBOARD_COLUMN_X(1);
+    const char* owner = "free";
+    LCDCOLOR color = GUI_COLOR_GREEN;
+
+    if(state->airspace >= 0) {
+        owner = topology_arms[state->airspace].name;
+        color = GUI_COLOR_ORANGE;
+    }
+
+    LCD_DrawRectF(x, DASHBOARD_ARM_Y, DASHBOARD_COLUMN_W, DASHBOARD_ARM_H, GUI_COLOR_BLACK);
+    LCD_DrawRect(x, DASHBOARD_ARM_Y, DASHBOARD_COLUMN_W, DASHBOARD_ARM_H, color);
+    LCD_SetTextColor(GUI_COLOR_WHITE);
+    LCD_DisplayStringXY(x + 4, DASHBOARD_ARM_Y + 4, "Airspace");
+    LCD_SetTextColor(color);
+    LCD_DisplayStringXY(x + 4, DASHBOARD_ARM_Y + 4 + DASHBOARD_CHAR_H + 2, owner);
+}
+
+/**
+ * @brief       Draws the throughput counters
+ * @type        static
+ * @param[in]   state   Copy of the dashboard state
+ * @return      None
+ **/
+static void dashboard_draw_counters(const dashboard_state_t* state)
+{
+    char text[64];
+    uint32_t total = state->blocks[0] + state->blocks[1];
+    uint32_t per_hour = 0;
+    TickType_t elapsed = xTaskGetTickCount() - state->first_block;
+
+    if(total > 1 && elapsed > 0) {
+        per_hour = (uint64_t)(total - 1) * 3600 * configTICK_RATE_HZ / elapsed;
+    }
+
+    LCD_DrawRectF(0, DASHBOARD_COUNTER_Y, 320, 2 * (DASHBOARD_CHAR_H + 2), GUI_COLOR_BLACK);
+    LCD_SetTextColor(GUI_COLOR_WHITE);
+    sprintf(text, "Blocks left: %lu  right: %lu  total: %lu", state->blocks[0], state->blocks[1], total);
+    LCD_DisplayStringXY(10, DASHBOARD_COUNTER_Y, text);
+    sprintf(text, "Throughput: %lu blocks/h", per_hour);
+    LCD_DisplayStringXY(10, DASHBOARD_COUNTER_Y + DASHBOARD_CHAR_H + 2, text);
+}
+
+/**
+ * @brief       Redraws all dirty elements. Must only be called by the display task.
+ * @type        global
+ * @return      None
+ **/
+void dashboard_render(void)
+{
+    dashboard_state_t state;
+    uint16_t dirty;
+
+    taskENTER_CRITICAL();
+    memcpy(&state, &dashboard_state, sizeof(dashboard_state_t));
+    dirty = dashboard_dirty;
+    dashboard_dirty = 0;
+    taskEXIT_CRITICAL();
+
+    for(uint8_t column = 0; column < DASHBOARD_BELTS && column < topology_belt_count; column++) {
+        if(dirty & (1 << (elem_belt_left + column))) {
+            dashboard_draw_belt(column, &state);
+        }
+    }
+    for(uint8_t index = 0; index < DASHBOARD_ARMS && index < topology_arm_count; index++) {
+        if(dirty & (1 << (elem_arm_left + index))) {
+            dashboard_draw_arm(index, &state);
+        }
+    }
+    if(dirty & (1 << elem_dispatcher)) {
+        dashboard_draw_dispatcher(&state);
+    }
+    if(dirty & (1 << elem_airspace)) {
+        dashboard_draw_airspace(&state);
+    }
+    if(dirty & (1 << elem_counters)) {
+        dashboard_draw_counters(&state);
+    }
+}
+
+/*@}*/
@@ -0,0 +1,26 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <stdint.h>
+#include "topology.h"
+
+/**
+ * @brief State of a belt as shown on the dashboard
+ */
+enum dashboard_belt_state {dashboard_belt_idle, //!< belt reset, no block expected
+                           dashboard_belt_waiting, //!< waiting on a block to be dropped
+                           dashboard_belt_moving, //!< belt running, block not yet at the end
+                           dashboard_belt_ready, //!< block at the end of the belt
+                           dashboard_belt_error //!< block detection timed out
+                          };
+
+//doc see dashboard.c
+void dashboard_belt_update(belt_id_t belt, enum dashboard_belt_state state, uint16_t position);
+void dashboard_dispatcher_update(int8_t direction);
+void dashboard_arm_update(arm_id_t arm, uint8_t waypoint);
+void dashboard_airspace_update(int8_t owner);
+void dashboard_count_block(arm_id_t arm);
+void dashboard_invalidate(void);
+void dashboard_render(void);
+
+#endif /* DASHBOARD_H */
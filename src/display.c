@@ -24,6 +24,11 @@
  *
  *****************************************************************************/
 #include "display.h"
+#include "sdlog.h"
+#include "telemetry.h"
+#include "dashboard.h"
+#include "loglevel.h"
+#include "switches.h"
 #include <FreeRTOS.h>
 #include <stdio.h>
 #include <task.h>
@@ -32,17 +37,21 @@
 #include <stdbool.h>
 #include <string.h>
 #include <semphr.h>
+#include <carme_io1.h>
 
 
 // -------------------- Configuration  ------------
 #define STACKSIZE_TASK        ( 256 ) //!< Stack size of the display task
 #define PRIORITY_TASK         ( 3 ) //!< Priority of the Display task  (low priority number denotes low priority task)
 
-#define QUEUE_SIZE 10 //!< Size of the message queue
+#define QUEUE_SIZE 30 //!< Size of the message queue (holds the messages of one frame period)
 
 #define DISPLAY_LINES   30 //!< Number of lines that fit on the display (vertically)
 #define DISPLAY_CHARS   64 //!< Number of horizontal characters that can be displayed
 
+#define DISPLAY_FRAME_PERIOD    40 //!< Time in ticks between two flushes to the panel (25 fps, every second panel frame)
+#define DISPLAY_VBLANK_TIMEOUT  2 //!< Max time in ticks to poll for the vertical blanking (if the controller does not answer)
+
 
 // ------------------ Implementation ------------------------
 
@@ -58,9 +67,19 @@ typedef struct {
 static uint8_t last_given_id = 0; //!< last given message id
 static QueueHandle_t display_queue; //!< Queue to send messages to the display task
 static SemaphoreHandle_t display_id_mutex; //!< Mutex so ensure atomic operations on last_given_id
+static uint32_t display_dropped = 0; //!< Number of messages dropped because the queue was full
+
+/**
+  @brief What the display shows
+  */
+enum display_mode {display_mode_log, //!< scrolling log of all messages
+                   display_mode_dashboard //!< graphical view of the cell, see \ref dashboard
+                  };
+
+static enum display_mode display_mode = display_mode_log; //!< Currently shown mode
 
 /**
- * @brief       Logs a message to the display
+ * @brief       Logs a message to the display. Never waits on the display task: If the queue is full, the message is dropped (it is still written to the sd log).
  * @type        global
  * @param[in]   uint8_t  id  Message-ID to overwrite. Pass \ref DISPLAY_NEWLINE to create a new message
  * @param[in]   const char*  fmtstr  Printf formatstring
@@ -98,8 +117,16 @@ uint8_t display_log(uint8_t id, const char *fmtstr, ...)
 
     msg.id = newId;
 
+    //Keep a persistent copy of the message
+    sdlog_write(msg.taskname, msg.message);
+    telemetry_log_record(msg.taskname, msg.message);
+
     //Send message to display task
-    xQueueSend(display_queue, &msg, portMAX_DELAY );
+    if(xQueueSend(display_queue, &msg, 0) != pdTRUE) {
+        taskENTER_CRITICAL();
+        display_dropped++;
+        taskEXIT_CRITICAL();
+    }
 
     return newId;
 
@@ -117,6 +144,10 @@ static void display_print_message(uint8_t line, log_message_t* msg)
 {
     uint8_t x=0;
 
+    if(display_mode != display_mode_log) { //messages are only buffered while the dashboard is shown
+        return;
+    }
+
     //Print task name in gray
     LCD_SetTextColor(GUI_COLOR_LIGHT_GRAY);
     const char* charPtr = msg->taskname;
@@ -142,21 +173,49 @@ static void display_print_message(uint8_t line, log_message_t* msg)
 uint8_t visible_messages=0; //!< Number of currently visible messages
 uint8_t buffer_offset = 0;  //!< Offset in the message_buffer to get to the top message
 log_message_t message_buffer[DISPLAY_LINES]; //!< buffer of all visible messages (ring buffer!)
+static uint32_t dirty_lines = 0; //!< Bitmask of the display lines which changed since the last flush
+
+#define DISPLAY_ALL_LINES       ((1UL << DISPLAY_LINES) - 1) //!< Bitmask with all display lines set
+#define DISPLAY_VBLANK_START    (TFT_VSYNC_PERIOD - TFT_VSYNC_FRONT_PORCH) //!< First scanline after the visible area
+#define DISPLAY_VBLANK_END      (TFT_VSYNC_PULSE + TFT_VSYNC_BACK_PORCH) //!< First visible scanline
 
 
 /**
- * @brief       DisplayTask that takes messages out of the queue and writes them to the display
+ * @brief       Switches between log and dashboard, according to the DIP switch
  * @type        static
  * @return      none
  **/
-static void display_task()
+static void display_update_mode()
 {
+    uint8_t switch_data;
+    CARME_IO1_SWITCH_Get(&switch_data);
+    enum display_mode mode = (switch_data & SWITCH_DASHBOARD) ? display_mode_dashboard : display_mode_log;
 
-    while(true) {
+    if(mode == display_mode) {
+        return;
+    }
+
+    display_mode = mode;
+    LCD_Clear(GUI_COLOR_BLACK);
+    if(mode == display_mode_log) {
+        dirty_lines = DISPLAY_ALL_LINES;
+    } else {
+        dashboard_invalidate();
+    }
+}
+
+/**
+ * @brief       Takes all pending messages out of the queue and stores them in the message buffer. Nothing is drawn yet.
+ * @type        static
+ * @return      none
+ **/
+static void display_receive_messages()
+{
+    static log_message_t tmp_message;
+
+    while(xQueueReceive(display_queue,&tmp_message,0) == pdTRUE) {
         uint8_t top_id = message_buffer[buffer_offset].id;
         uint8_t bottom_id  = message_buffer[(buffer_offset + visible_messages -1 )%DISPLAY_LINES].id;
-        static log_message_t tmp_message;
-        xQueueReceive(display_queue,&tmp_message,portMAX_DELAY);
         uint8_t new_id = tmp_message.id;
 
         //Check if message has the same id as a message that is currently beeing displayed
@@ -165,30 +224,110 @@ static void display_task()
             //Replace message
             uint8_t replace_buffer_index =(buffer_offset + (new_id-top_id)) % DISPLAY_LINES;
             memcpy(&message_buffer[replace_buffer_index],&tmp_message,sizeof(log_message_t));
-            display_print_message(new_id-top_id, &message_buffer[replace_buffer_index]);
+            dirty_lines |= 1UL << (uint8_t)(new_id-top_id);
         } else if(top_id > bottom_id && new_id <= bottom_id ) {
             //Replace message (and handle index wraping)
             uint8_t replace_buffer_index =(buffer_offset + visible_messages -1 - (bottom_id-new_id)) % DISPLAY_LINES;
             memcpy(&message_buffer[replace_buffer_index],&tmp_message,sizeof(log_message_t));
-            display_print_message(visible_messages -1 - (bottom_id-new_id), &message_buffer[replace_buffer_index]);
+            dirty_lines |= 1UL << (uint8_t)(visible_messages -1 - (bottom_id-new_id));
         } else { //message is new
             if(visible_messages == DISPLAY_LINES) {
                 memcpy(&message_buffer[buffer_offset],&tmp_message,sizeof(log_message_t));
                 buffer_offset = (buffer_offset +1) % DISPLAY_LINES;
-                for(uint8_t i =0; i< DISPLAY_LINES; i++) {
-                    uint8_t buffer_index = (buffer_offset + i) % DISPLAY_LINES;
-                    display_print_message(i,&message_buffer[buffer_index]);
-                }
+                dirty_lines = DISPLAY_ALL_LINES; //scrolled
             } else { // Display not full yet
                 uint8_t buffer_index = (buffer_offset + visible_messages) % DISPLAY_LINES;
                 memcpy(&message_buffer[buffer_index],&tmp_message,sizeof(log_message_t));
-                display_print_message(visible_messages,&message_buffer[buffer_index]);
+                dirty_lines |= 1UL << visible_messages;
                 visible_messages++;
             }
         }
     }
 }
 
+/**
+ * @brief       Redraws all lines of the log which changed since the last flush
+ * @type        static
+ * @return      none
+ **/
+static void display_flush_log()
+{
+    for(uint8_t i =0; i< visible_messages && dirty_lines != 0; i++) {
+        if(dirty_lines & (1UL << i)) {
+            display_print_message(i,&message_buffer[(buffer_offset + i) % DISPLAY_LINES]);
+        }
+    }
+    dirty_lines = 0;
+}
+
+/**
+ * @brief       Reads the scanline which the SSD1963 is currently sending to the panel
+ * @type        static
+ * @return      uint16_t scanline (0 = start of the vsync pulse)
+ **/
+static uint16_t display_get_scanline()
+{
+    SSD1963_WriteCommand(CMD_GET_SCANLINE);
+    uint16_t high = SSD1963_ReadData() & 0xFF;
+    uint16_t low = SSD1963_ReadData() & 0xFF;
+    return (high << 8) | low;
+}
+
+/**
+ * @brief       Waits until the panel enters the vertical blanking, so that the following writes do not tear.
+ *              Sleeps for most of the remaining frame and polls the scanline only for the last tick.
+ * @type        static
+ * @return      none
+ **/
+static void display_wait_vblank()
+{
+    uint16_t line = display_get_scanline();
+    if(line >= DISPLAY_VBLANK_START || line < DISPLAY_VBLANK_END) {
+        return; //already in the blanking
+    }
+
+    TickType_t remaining = (DISPLAY_VBLANK_START - line) * configTICK_RATE_HZ / (TFT_FPS * TFT_VSYNC_PERIOD);
+    if(remaining > 1) {
+        vTaskDelay(remaining - 1);
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    do {
+        line = display_get_scanline();
+    } while(line < DISPLAY_VBLANK_START && line >= DISPLAY_VBLANK_END &&
+            xTaskGetTickCount() - start <= DISPLAY_VBLANK_TIMEOUT);
+}
+
+/**
+ * @brief       DisplayTask that collects the messages of a frame period and flushes them at once, during the vertical blanking
+ * @type        static
+ * @return      none
+ **/
+static void display_task()
+{
+    TickType_t last_frame = xTaskGetTickCount();
+    uint32_t reported_dropped = 0;
+    uint8_t dropped_line = DISPLAY_NEWLINE;
+
+    while(true) {
+        vTaskDelayUntil(&last_frame, DISPLAY_FRAME_PERIOD);
+        display_receive_messages();
+
+        if(display_dropped != reported_dropped) { //the queue is empty now, so the report itself fits
+            reported_dropped = display_dropped;
+            dropped_line = LOG(DISPLAY, LOG_WARN, dropped_line, "Display: %lu messages dropped", reported_dropped);
+        }
+
+        display_wait_vblank();
+        display_update_mode();
+        if(display_mode == display_mode_dashboard) {
+            dashboard_render();
+        } else {
+            display_flush_log();
+        }
+    }
+}
+
 
 
 /**
@@ -200,6 +339,7 @@ void display_init()
 {
     LCD_Init();
     LCD_Clear(GUI_COLOR_BLACK);
+    SSD1963_SetTearingCfg(true, 0); //tearing effect signal on vblank only
     xTaskCreate(display_task,
                 "Display Task",
                 STACKSIZE_TASK,
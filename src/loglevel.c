@@ -0,0 +1,125 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup loglevel Log Level
+ * @brief Per module log levels, filtered at compile time and switchable at runtime
+ *
+ * Use the \ref LOG macro instead of calling display_log directly. Messages above the compile time
+ * threshold (LOG_LEVEL_UCAN, LOG_LEVEL_BCS, ...) do not produce any code. The remaining ones are
+ * filtered by the runtime level of the module, which can be changed with the CAN message \ref LOG_CAN_COMMAND_ID
+ * (the DIP switches are all taken, see switches.h).
+ */
+/*@{*/
+
+#include "loglevel.h"
+#include "ucan.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+// -------------------- Configuration  ------------
+#define STACKSIZE_TASK        ( 256 ) //!< Stack size of the log level task
+#define PRIORITY_TASK         ( 1 ) //!< Priority of the log level task
+
+#define LOG_CAN_COMMAND_ID    0x1F0 //!< CAN id to set a level. data[0]: module (0xFF for all), data[1]: level
+#define LOG_CAN_ALL_MODULES   0xFF //!< Module value which addresses all modules
+
+
+// ------------------ Implementation ------------------------
+
+static const uint8_t log_default_levels[LOG_MODULE_COUNT] = {LOG_LEVEL_UCAN, LOG_LEVEL_BCS, LOG_LEVEL_ARM, LOG_LEVEL_DISPLAY, LOG_LEVEL_METRICS}; //!< Runtime levels after reset
+
+volatile uint8_t log_levels[LOG_MODULE_COUNT] = {LOG_LEVEL_UCAN, LOG_LEVEL_BCS, LOG_LEVEL_ARM, LOG_LEVEL_DISPLAY, LOG_LEVEL_METRICS}; //!< Current runtime levels
+
+static QueueHandle_t log_can_queue; //!< Queue to receive the level commands from can
+
+
+/**
+ * @brief       Sets the runtime level of a module. Levels above the compile time threshold have no effect.
+ * @type        global
+ * @param[in]   module  The module to change
+ * @param[in]   level   One of the LOG_* levels
+ * @return      None
+ **/
+void log_set_level(enum log_module module, uint8_t level)
+{
+    if(module >= LOG_MODULE_COUNT) {
+        return;
+    }
+    if(level > LOG_TRACE) {
+        level = LOG_TRACE;
+    }
+    log_levels[module] = level;
+}
+
+/**
+ * @brief       Applies a level to all modules
+ * @type        static
+ * @param[in]   level   One of the LOG_* levels, or LOG_NONE to restore the defaults
+ * @return      None
+ **/
+static void log_set_all(uint8_t level)
+{
+    for(uint8_t module = 0; module < LOG_MODULE_COUNT; module++) {
+        log_set_level(module, level == LOG_NONE ? log_default_levels[module] : level);
+    }
+}
+
+/**
+ * @brief       Task which applies level changes from CAN
+ * @type        static
+ * @param[in]   pv_data     Not used
+ * @return      None
+ **/
+static void loglevel_task(void *pv_data)
+{
+    CARME_CAN_MESSAGE msg;
+
+    while(true) {
+        if(xQueueReceive(log_can_queue, &msg, portMAX_DELAY) == pdTRUE && msg.dlc >= 2) {
+            if(msg.data[0] == LOG_CAN_ALL_MODULES) {
+                log_set_all(msg.data[1]);
+            } else {
+                log_set_level(msg.data[0], msg.data[1]);
+            }
+            LOG(DISPLAY, LOG_INFO, DISPLAY_NEWLINE, "Log level of module %u set to %u", msg.data[0], msg.data[1]);
+        }
+    }
+}
+
+/**
+ * @brief       Starts the task which listens for level changes
+ * @type        global
+ * @return      None
+ **/
+void loglevel_init()
+{
+    log_can_queue = xQueueCreate(1, sizeof(CARME_CAN_MESSAGE));
+    ucan_link_message_to_queue(LOG_CAN_COMMAND_ID, log_can_queue);
+
+    xTaskCreate(loglevel_task,
+                "Log Level",
+                STACKSIZE_TASK,
+                NULL,
+                PRIORITY_TASK,
+                NULL);
+}
+
+/*@}*/
@@ -0,0 +1,63 @@
+#ifndef LOGLEVEL_H
+#define LOGLEVEL_H
+
+#include <stdint.h>
+#include "display.h"
+
+#define LOG_NONE    0 //!< Nothing is logged
+#define LOG_ERROR   1 //!< The cell can not continue without help
+#define LOG_WARN    2 //!< Something unexpected happened, but the cell continues
+#define LOG_INFO    3 //!< Progress of the cell (one message per step)
+#define LOG_DEBUG   4 //!< Details of a step, including messages from polling loops
+#define LOG_TRACE   5 //!< Every single CAN message
+
+/* Compile time thresholds. Messages above the threshold of their module are removed by the compiler. Override with -D. */
+#ifndef LOG_LEVEL_UCAN
+#define LOG_LEVEL_UCAN      LOG_WARN //!< Compile time threshold of the ucan module
+#endif
+#ifndef LOG_LEVEL_BCS
+#define LOG_LEVEL_BCS       LOG_DEBUG //!< Compile time threshold of the bcs module
+#endif
+#ifndef LOG_LEVEL_ARM
+#define LOG_LEVEL_ARM       LOG_DEBUG //!< Compile time threshold of the arm module
+#endif
+#ifndef LOG_LEVEL_DISPLAY
+#define LOG_LEVEL_DISPLAY   LOG_INFO //!< Compile time threshold of the display and its log sinks
+#endif
+#ifndef LOG_LEVEL_METRICS
+#define LOG_LEVEL_METRICS   LOG_INFO //!< Compile time threshold of the metrics reports (LOG_DEBUG: every stage)
+#endif
+
+/**
+ * @brief Modules with their own log level
+ */
+enum log_module {LOG_MODULE_UCAN, //!< ubor CAN
+                 LOG_MODULE_BCS, //!< belt conveyer system
+                 LOG_MODULE_ARM, //!< robot arms
+                 LOG_MODULE_DISPLAY, //!< display and log sinks
+                 LOG_MODULE_METRICS, //!< stage timing reports
+                 LOG_MODULE_COUNT
+                };
+
+extern volatile uint8_t log_levels[LOG_MODULE_COUNT]; //!< Runtime levels, see loglevel.c
+
+/**
+ * @brief Logs a message if the level is enabled for the module, at compile time and at runtime.
+ * @param module Module name in upper case (UCAN, BCS, ARM, DISPLAY, METRICS)
+ * @param level  One of the LOG_* levels
+ * @param id     Message-ID to overwrite, or \ref DISPLAY_NEWLINE
+ * @return The id of the printed message, or the passed id if the message was filtered
+ */
+#define LOG(module, level, id, ...) ({ \
+    uint8_t log_id = (id); \
+    if((level) <= LOG_LEVEL_##module && (level) <= log_levels[LOG_MODULE_##module]) { \
+        log_id = display_log(log_id, __VA_ARGS__); \
+    } \
+    log_id; \
+})
+
+//doc see loglevel.c
+void log_set_level(enum log_module module, uint8_t level);
+void loglevel_init();
+
+#endif /* LOGLEVEL_H */
@@ -22,12 +22,18 @@
 #include <carme.h>
 #include <carme_io1.h>
 #include <carme_io2.h>
+#include <rtc.h>
 #include <task.h>
 
 #include "ucan.h"
 #include "display.h"
+#include "sdlog.h"
+#include "telemetry.h"
+#include "loglevel.h"
+#include "metrics.h"
 #include "bcs.h"
 #include "arm.h"
+#include "teach.h"
 
 /**
  * @brief      Main function which calls the scheduler
@@ -38,11 +44,17 @@ int  main(void)
     /* initialize the IO libs */
     CARME_IO1_Init();
     CARME_IO2_Init();
+    CARME_RTC_Init();
 
     /* Call init functions */
     ucan_init();
     display_init();
+    sdlog_init();
+    telemetry_init();
+    loglevel_init();
+    metrics_init();
     bcs_init();
+    teach_init();
     init_arm();
 
     /* Start scheduler */
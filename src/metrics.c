@@ -0,0 +1,267 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup metrics Metrics
+ * @brief Timing of the stages of all belts and arms, with utilization and bottleneck
+ *
+ * The belt and arm tasks call \ref metrics_record at the end of every stage. Per station and stage the
+ * min/avg/max and a histogram of the durations are kept for one window of \ref METRICS_WINDOW ticks.
+ * At the end of the window the utilization of every station (time not spent waiting on other stations)
+ * and the bottleneck are logged, the details of every stage are logged at debug level and sent as telemetry frames.
+ */
+/*@{*/
+
+#include "metrics.h"
+#include "loglevel.h"
+#include "telemetry.h"
+#include <task.h>
+#include <stdio.h>
+#include <string.h>
+
+// -------------------- Configuration  ------------
+#define STACKSIZE_TASK        ( 512 ) //!< Stack size of the metrics task
+#define PRIORITY_TASK         ( 1 ) //!< Priority of the metrics task
+
+#define METRICS_WINDOW        60000 //!< Length of a window in ticks. The stats are reported and cleared after each window
+
+
+// ------------------ Implementation ------------------------
+
+/**
+ * @brief Durations of one stage of one station, in ms
+ */
+typedef struct {
+    uint32_t count; //!< Number of samples
+    uint32_t sum; //!< Sum of all samples
+    uint16_t min; //!< Shortest sample
+    uint16_t max; //!< Longest sample
+    uint16_t histogram[METRICS_BUCKETS]; //!< Samples per bucket, see \ref metrics_bucket
+} metrics_stage_t;
+
+/**
+ * @brief Telemetry frame with the stats of one stage (\ref telemetry_metrics)
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t tick; //!< End of the window
+    uint8_t station; //!< Station index (belts first, then the arms)
+    uint8_t stage; //!< Stage index
+    metrics_stage_t stats; //!< Stats of the stage
+}
+metrics_frame_t;
+
+static metrics_stage_t metrics[METRICS_STATIONS][METRICS_MAX_STAGES]; //!< Stats of the current window
+
+static const char* const metrics_bcs_stage_names[metrics_bcs_stage_count] = {"reset", "drop", "start", "detect", "dispatch", "done", "recovery", "end", "target"}; //!< Names for the log
+
+
+/**
+ * @brief       Returns the histogram bucket of a duration
+ * @type        static
+ * @param[in]   ms  Duration in ms
+ * @return      0 for 0 ms, 1 for 1 ms, 2 for 2-3 ms, 3 for 4-7 ms ... \ref METRICS_BUCKETS - 1 for all longer durations
+ **/
+static uint8_t metrics_bucket(uint32_t ms)
+{
+    if(ms == 0) {
+        return 0;
+    }
+    uint8_t bucket = 32 - __builtin_clz(ms);
+    return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+/**
+ * @brief       Records the duration of a stage, which lasted from start until now
+ * @type        global
+ * @param[in]   station Station index, use \ref METRICS_BELT or \ref METRICS_ARM
+ * @param[in]   stage   Stage index (\ref metrics_bcs_stage for belts, the waypoint, \ref METRICS_ARM_WAIT or \ref METRICS_ARM_AIRSPACE for arms)
+ * @param[in]   start   Tick count at the start of the stage
+ * @return      The current tick count, which is the start of the next stage
+ **/
+TickType_t metrics_record(uint8_t station, uint8_t stage, TickType_t start)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint32_t ms = (now - start) * portTICK_PERIOD_MS;
+    uint16_t clamped = ms > 0xFFFF ? 0xFFFF : ms;
+
+    if(station >= METRICS_STATIONS || stage >= METRICS_MAX_STAGES) {
+        return now;
+    }
+
+    metrics_stage_t* stats = &metrics[station][stage];
+    taskENTER_CRITICAL();
+    if(stats->count == 0 || clamped < stats->min) {
+        stats->min = clamped;
+    }
+    if(clamped > stats->max) {
+        stats->max = clamped;
+    }
+    stats->count++;
+    stats->sum += ms;
+    stats->histogram[metrics_bucket(ms)]++;
+    taskEXIT_CRITICAL();
+
+    return now;
+}
+
+/**
+ * @brief       Returns the name of a stage
+ * @type        static
+ * @param[in]   station Station index
+ * @param[in]   stage   Stage index
+ * @param[out]  buffer  Buffer for generated names (at least 8 chars)
+ * @return      The name
+ **/
+static const char* metrics_stage_name(uint8_t station, uint8_t stage, char* buffer)
+{
+    if(station < TOPOLOGY_MAX_BELTS) {
+        return stage < metrics_bcs_stage_count ? metrics_bcs_stage_names[stage] : "?";
+    }
+    if(stage == METRICS_ARM_WAIT) {
+        return "wait";
+    }
+    if(stage == METRICS_ARM_AIRSPACE) {
+        return "air";
+    }
+    sprintf(buffer, "wp%u", stage);
+    return buffer;
+}
+
+/**
+ * @brief       Returns whether a stage is spent waiting on another station (not counted as busy)
+ * @type        static
+ * @param[in]   station Station index
+ * @param[in]   stage   Stage index
+ * @return      true for waiting stages
+ **/
+static bool metrics_is_waiting(uint8_t station, uint8_t stage)
+{
+    if(station < TOPOLOGY_MAX_BELTS) {
+        return stage == metrics_bcs_await_drop || stage == metrics_bcs_await_end || stage == metrics_bcs_await_target;
+    }
+    return stage == METRICS_ARM_WAIT || stage == METRICS_ARM_AIRSPACE;
+}
+
+/**
+ * @brief       Reports and clears the stats of one station
+ * @type        static
+ * @param[in]   station Station index
+ * @param[in]   name    Name of the station
+ * @param[in]   window  Length of the window in ms
+ * @return      Utilization of the station in percent
+ **/
+static uint32_t metrics_report_station(uint8_t station, const char* name, uint32_t window)
+{
+    static metrics_frame_t frame;
+    char buffer[8];
+    uint32_t busy = 0;
+    uint32_t slowest_sum = 0;
+    uint8_t slowest = 0;
+
+    frame.tick = xTaskGetTickCount();
+    frame.station = station;
+
+    for(uint8_t stage = 0; stage < METRICS_MAX_STAGES; stage++) {
+        taskENTER_CRITICAL();
+        memcpy(&frame.stats, &metrics[station][stage], sizeof(metrics_stage_t));
+        memset(&metrics[station][stage], 0, sizeof(metrics_stage_t));
+        taskEXIT_CRITICAL();
+
+        if(frame.stats.count == 0) {
+            continue;
+        }
+
+        frame.stage = stage;
+        telemetry_send(telemetry_metrics, (uint8_t*)&frame, sizeof(frame));
+        LOG(METRICS, LOG_DEBUG, DISPLAY_NEWLINE, "%s %s: n %lu min %u avg %lu max %u ms", name,
+            metrics_stage_name(station, stage, buffer), frame.stats.count, frame.stats.min,
+            frame.stats.sum / frame.stats.count, frame.stats.max);
+
+        if(!metrics_is_waiting(station, stage)) {
+            busy += frame.stats.sum;
+            if(frame.stats.sum > slowest_sum) {
+                slowest_sum = frame.stats.sum;
+                slowest = stage;
+            }
+        }
+    }
+
+    uint32_t utilization = busy * 100 / window;
+    if(busy > 0) {
+        LOG(METRICS, LOG_INFO, DISPLAY_NEWLINE, "%s: util %lu%%, most time in %s (%lu%%)", name, utilization,
+            metrics_stage_name(station, slowest, buffer), slowest_sum * 100 / window);
+    }
+    return utilization;
+}
+
+/**
+ * @brief       Task which reports the stats at the end of every window
+ * @type        static
+ * @param[in]   pv_data     Not used
+ * @return      None
+ **/
+static void metrics_task(void *pv_data)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    uint32_t window = METRICS_WINDOW * portTICK_PERIOD_MS;
+
+    while(true) {
+        vTaskDelayUntil(&last_wake, METRICS_WINDOW);
+
+        uint32_t max_utilization = 0;
+        const char* bottleneck = NULL;
+
+        for(belt_id_t belt = 0; belt < topology_belt_count; belt++) {
+            uint32_t utilization = metrics_report_station(METRICS_BELT(belt), topology_belts[belt].name, window);
+            if(utilization > max_utilization) {
+                max_utilization = utilization;
+                bottleneck = topology_belts[belt].name;
+            }
+        }
+        for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+            uint32_t utilization = metrics_report_station(METRICS_ARM(arm), topology_arms[arm].name, window);
+            if(utilization > max_utilization) {
+                max_utilization = utilization;
+                bottleneck = topology_arms[arm].name;
+            }
+        }
+
+        if(bottleneck != NULL) {
+            LOG(METRICS, LOG_INFO, DISPLAY_NEWLINE, "Bottleneck: %s (%lu%% busy)", bottleneck, max_utilization);
+        }
+    }
+}
+
+/**
+ * @brief       Starts the metrics task
+ * @type        global
+ * @return      None
+ **/
+void metrics_init()
+{
+    xTaskCreate(metrics_task,
+                "Metrics",
+                STACKSIZE_TASK,
+                NULL,
+                PRIORITY_TASK,
+                NULL);
+}
+
+/*@}*/
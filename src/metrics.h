@@ -0,0 +1,37 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include "topology.h"
+
+#define METRICS_MAX_STAGES      16 //!< Max number of stages per station
+#define METRICS_BUCKETS         12 //!< Histogram buckets: 0 ms, 1 ms, 2-3 ms, 4-7 ms, ... >= 1024 ms
+#define METRICS_STATIONS        (TOPOLOGY_MAX_BELTS + TOPOLOGY_MAX_ARMS) //!< Belts first, then the arms
+
+#define METRICS_BELT(belt)      (belt) //!< Station index of a belt
+#define METRICS_ARM(arm)        (TOPOLOGY_MAX_BELTS + (arm)) //!< Station index of an arm
+
+/**
+ * @brief Stages of a belt task (bcs_task)
+ */
+enum metrics_bcs_stage {metrics_bcs_reset, //!< reset of the belt (and the dispatcher)
+                        metrics_bcs_await_drop, //!< waiting on a block to be dropped (starved)
+                        metrics_bcs_start, //!< starting the belt
+                        metrics_bcs_detect, //!< block detection and moving the block to the end
+                        metrics_bcs_dispatch, //!< handoff to the arm, or dispatching the block
+                        metrics_bcs_done, //!< finishing the block
+                        metrics_bcs_recovery, //!< recovery after a lost block
+                        metrics_bcs_await_end, //!< waiting on the free end zone before the belt starts (blocked downstream)
+                        metrics_bcs_await_target, //!< waiting on the free drop zone of the dispatcher target (blocked downstream)
+                        metrics_bcs_stage_count
+                       };
+
+#define METRICS_ARM_WAIT        (METRICS_MAX_STAGES - 1) //!< Stage of an arm: waiting on a belt. The other stages are the waypoints.
+#define METRICS_ARM_AIRSPACE    (METRICS_MAX_STAGES - 2) //!< Stage of an arm: waiting on the airspace (zones held by other arms)
+
+//doc see metrics.c
+TickType_t metrics_record(uint8_t station, uint8_t stage, TickType_t start);
+void metrics_init();
+
+#endif /* METRICS_H */
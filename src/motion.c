@@ -0,0 +1,314 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup motion Motion
+ * @brief Time model of the arm joints, fitted from the measured moves
+ *
+ * For every move of an arm, the time from the command until each joint arrived within the stop
+ * tolerance is recorded against the distance of the joint (\ref motion_record). Per arm and joint
+ * a line time = offset + slope * distance is fitted by least squares. The sums are halved after
+ * \ref MOTION_MAX_SAMPLES samples, so the model follows a change of the arm (load, wear).
+ * The model predicts the duration of a move (\ref motion_predict), which the arm uses to tell the
+ * belts when it is ready for the next block. It is sent as telemetry frames once per arm cycle.
+ *
+ * The fitted model is stored in the EEPROM every \ref MOTION_SAVE_PERIOD (a record behind the taught
+ * waypoints, see \ref teach_store) and loaded by \ref motion_init. After a restart, a joint uses the stored
+ * model instead of the default until it has enough new samples, so the first cycles are predicted as well.
+ *
+ * The resolution is the poll interval of the arm position (10 ms close to the target).
+ */
+/*@{*/
+
+#include "motion.h"
+#include "loglevel.h"
+#include "telemetry.h"
+#include "teach.h"
+#include <task.h>
+#include <stdlib.h>
+
+// -------------------- Configuration  ------------
+#define MOTION_MIN_SAMPLES    8 //!< Samples of a joint before its model replaces the default
+#define MOTION_MAX_SAMPLES    256 //!< Samples after which the sums are halved
+#define MOTION_DEFAULT_SLOPE  25 //!< Time in ms per unit, until a joint has enough samples
+#define MOTION_Q              8 //!< Fraction bits of the slope
+#define MOTION_SAVE_PERIOD    600000 //!< Time in ticks between two saves of the model (10 minutes, some 50000 EEPROM writes a year)
+#define MOTION_EEPROM_BASE    TEACH_RECORD_BASE //!< First EEPROM address of the stored model
+#define MOTION_MAGIC          0x30DE //!< Upper half of the header word of a valid record
+
+
+// ------------------ Implementation ------------------------
+
+/**
+ * @brief Samples and fitted model of one joint
+ */
+typedef struct {
+    uint32_t n; //!< Number of samples (halved after MOTION_MAX_SAMPLES)
+    uint32_t sum_x; //!< Sum of the distances
+    uint32_t sum_y; //!< Sum of the times in ms
+    uint32_t sum_xx; //!< Sum of the squared distances
+    uint32_t sum_xy; //!< Sum of distance * time
+    int32_t offset; //!< Fitted time in ms of every move (reaction and settling)
+    int32_t slope; //!< Fitted time in ms per unit, with MOTION_Q fraction bits
+    int32_t prior_offset; //!< Offset until the joint has MOTION_MIN_SAMPLES samples (default or stored)
+    int32_t prior_slope; //!< Slope until the joint has MOTION_MIN_SAMPLES samples (default or stored)
+} motion_joint_t;
+
+/**
+ * @brief Telemetry frame with the model of one joint (\ref telemetry_motion)
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t tick; //!< Time of the export
+    uint8_t arm; //!< Arm index
+    uint8_t joint; //!< Joint index (1 base ... 5 gripper)
+    uint16_t samples; //!< Number of samples in the model
+    int32_t offset; //!< Offset in ms
+    int32_t slope; //!< Slope in ms per unit, with MOTION_Q fraction bits
+}
+motion_frame_t;
+
+#define MOTION_JOINTS         (TOPOLOGY_AXES - 1) //!< Joints of an arm which are modelled (without the arm byte)
+#define MOTION_RECORD_WORDS   (1 + TOPOLOGY_MAX_ARMS * MOTION_JOINTS + 1) //!< Max size of the record: header, one word per joint, CRC
+
+static motion_joint_t motion[TOPOLOGY_MAX_ARMS][TOPOLOGY_AXES]; //!< Model of each joint of each arm
+static uint32_t motion_record_buffer[MOTION_RECORD_WORDS]; //!< Record as it is stored in the EEPROM: header, offset and slope of each joint, CRC
+static TickType_t motion_saved; //!< Time of the last save
+
+
+/**
+ * @brief       Fits the line through the samples of a joint. Must be called in a critical section.
+ * @type        static
+ * @param[in,out] joint The joint
+ * @return      None
+ **/
+static void motion_fit(motion_joint_t* joint)
+{
+    int64_t n = joint->n;
+    int64_t den = n * joint->sum_xx - (int64_t)joint->sum_x * joint->sum_x;
+
+    if(joint->n < MOTION_MIN_SAMPLES || joint->sum_xx == 0) {
+        joint->offset = joint->prior_offset;
+        joint->slope = joint->prior_slope;
+        return;
+    }
+    if(den <= 0) { //all distances alike: line through the origin
+        joint->offset = 0;
+        joint->slope = ((int64_t)joint->sum_xy << MOTION_Q) / joint->sum_xx;
+        return;
+    }
+
+    int64_t slope = ((n * joint->sum_xy - (int64_t)joint->sum_x * joint->sum_y) << MOTION_Q) / den;
+    joint->slope = slope > 0 ? slope : 0;
+    joint->offset = ((int64_t)joint->sum_y - ((joint->slope * (int64_t)joint->sum_x) >> MOTION_Q)) / n;
+}
+
+/**
+ * @brief       Records the move of an arm
+ * @type        global
+ * @param[in]   arm     The arm
+ * @param[in]   from    Position at the command
+ * @param[in]   to      Commanded position
+ * @param[in]   arrived Time in ms from the command until each joint arrived, 0 if it did not arrive
+ * @return      None
+ **/
+void motion_record(arm_id_t arm, const uint8_t* from, const uint8_t* to, const uint32_t* arrived)
+{
+    for(int i = 1; i < TOPOLOGY_AXES; i++) {
+        uint32_t x = abs((int8_t)to[i] - (int8_t)from[i]);
+        uint32_t y = arrived[i];
+        motion_joint_t* joint = &motion[arm][i];
+
+        if(x == 0 || y == 0) {
+            continue;
+        }
+
+        taskENTER_CRITICAL();
+        if(joint->n >= MOTION_MAX_SAMPLES) {
+            joint->n /= 2;
+            joint->sum_x /= 2;
+            joint->sum_y /= 2;
+            joint->sum_xx /= 2;
+            joint->sum_xy /= 2;
+        }
+        joint->n++;
+        joint->sum_x += x;
+        joint->sum_y += y;
+        joint->sum_xx += x * x;
+        joint->sum_xy += x * y;
+        motion_fit(joint);
+        taskEXIT_CRITICAL();
+    }
+}
+
+/**
+ * @brief       Predicts the duration of a move. The joints move at the same time, the slowest one counts.
+ * @type        global
+ * @param[in]   arm     The arm
+ * @param[in]   from    Start position
+ * @param[in]   to      Target position
+ * @return      Predicted time in ticks until all joints arrived
+ **/
+TickType_t motion_predict(arm_id_t arm, const uint8_t* from, const uint8_t* to)
+{
+    int32_t longest = 0;
+
+    for(int i = 1; i < TOPOLOGY_AXES; i++) {
+        int32_t x = abs((int8_t)to[i] - (int8_t)from[i]);
+        if(x == 0) {
+            continue;
+        }
+        int32_t ms = motion[arm][i].offset + ((motion[arm][i].slope * x) >> MOTION_Q);
+        longest = ms > longest ? ms : longest;
+    }
+    return longest / portTICK_PERIOD_MS;
+}
+
+/**
+ * @brief       Returns the number of words of the record of the topology
+ * @type        static
+ * @return      The number of words, including header and CRC
+ **/
+static uint16_t motion_record_words()
+{
+    return 1 + topology_arm_count * MOTION_JOINTS + 1;
+}
+
+/**
+ * @brief       Stores the model of all joints in the EEPROM, at most every \ref MOTION_SAVE_PERIOD
+ *              and only once some joint has enough samples. Blocks the calling arm task for some 40 ms.
+ *              Offset and slope are stored as 16 bit each.
+ * @type        static
+ * @return      None
+ **/
+static void motion_save()
+{
+    TickType_t now = xTaskGetTickCount();
+    uint16_t words = motion_record_words();
+    bool fitted = false;
+
+    taskENTER_CRITICAL(); //the arms export at the same time
+    bool due = now - motion_saved >= MOTION_SAVE_PERIOD;
+    if(due) {
+        motion_saved = now;
+    }
+    taskEXIT_CRITICAL();
+    if(!due) {
+        return;
+    }
+
+    motion_record_buffer[0] = (uint32_t)MOTION_MAGIC << 16 | words;
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        for(int i = 1; i < TOPOLOGY_AXES; i++) {
+            taskENTER_CRITICAL();
+            int32_t offset = motion[arm][i].offset;
+            int32_t slope = motion[arm][i].slope;
+            fitted |= motion[arm][i].n >= MOTION_MIN_SAMPLES;
+            taskEXIT_CRITICAL();
+
+            offset = offset < INT16_MIN ? INT16_MIN : offset > INT16_MAX ? INT16_MAX : offset;
+            slope = slope > UINT16_MAX ? UINT16_MAX : slope;
+            motion_record_buffer[1 + arm * MOTION_JOINTS + i - 1] = (uint32_t)(uint16_t)offset << 16 | (uint16_t)slope;
+        }
+    }
+
+    if(fitted && !teach_store(MOTION_EEPROM_BASE, motion_record_buffer, words)) {
+        LOG(ARM, LOG_WARN, DISPLAY_NEWLINE, "Saving the motion model failed");
+    }
+}
+
+/**
+ * @brief       Loads the stored model as the prior of all joints of the topology
+ * @type        static
+ * @return      None
+ **/
+static void motion_load()
+{
+    uint16_t words = motion_record_words();
+
+    if(!teach_load(MOTION_EEPROM_BASE, motion_record_buffer, words) ||
+            motion_record_buffer[0] != ((uint32_t)MOTION_MAGIC << 16 | words)) {
+        LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "No stored motion model, using defaults");
+        return;
+    }
+
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        for(int i = 1; i < TOPOLOGY_AXES; i++) {
+            uint32_t word = motion_record_buffer[1 + arm * MOTION_JOINTS + i - 1];
+            motion[arm][i].prior_offset = (int16_t)(word >> 16);
+            motion[arm][i].prior_slope = (uint16_t)word;
+        }
+    }
+    LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "Loaded the motion model");
+}
+
+/**
+ * @brief       Sends the model of all joints of an arm as telemetry frames and logs it. Stores the model, if a save is due.
+ * @type        global
+ * @param[in]   arm     The arm
+ * @return      None
+ **/
+void motion_export(arm_id_t arm)
+{
+    static motion_frame_t frame;
+
+    frame.tick = xTaskGetTickCount();
+    frame.arm = arm;
+    for(int i = 1; i < TOPOLOGY_AXES; i++) {
+        taskENTER_CRITICAL();
+        frame.joint = i;
+        frame.samples = motion[arm][i].n;
+        frame.offset = motion[arm][i].offset;
+        frame.slope = motion[arm][i].slope;
+        taskEXIT_CRITICAL();
+
+        if(frame.samples < MOTION_MIN_SAMPLES) {
+            continue;
+        }
+        telemetry_send(telemetry_motion, (uint8_t*)&frame, sizeof(frame));
+        LOG(ARM, LOG_DEBUG, DISPLAY_NEWLINE, "%s j%u: %ld ms + %ld.%02lu ms/unit (n %u)", topology_arms[arm].name, i,
+            frame.offset, frame.slope >> MOTION_Q, ((frame.slope & ((1 << MOTION_Q) - 1)) * 100) >> MOTION_Q, frame.samples);
+    }
+    motion_save();
+}
+
+/**
+ * @brief       Sets the default model of all joints and loads the stored one. Must be called after \ref teach_init.
+ * @type        global
+ * @return      None
+ **/
+void motion_init()
+{
+    for(arm_id_t arm = 0; arm < TOPOLOGY_MAX_ARMS; arm++) {
+        for(int i = 0; i < TOPOLOGY_AXES; i++) {
+            motion[arm][i].prior_offset = 0;
+            motion[arm][i].prior_slope = MOTION_DEFAULT_SLOPE << MOTION_Q;
+        }
+    }
+    motion_load();
+
+    for(arm_id_t arm = 0; arm < TOPOLOGY_MAX_ARMS; arm++) {
+        for(int i = 0; i < TOPOLOGY_AXES; i++) {
+            motion_fit(&motion[arm][i]);
+        }
+    }
+    motion_saved = xTaskGetTickCount();
+}
+
+/*@}*/
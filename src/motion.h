@@ -0,0 +1,14 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include "topology.h"
+
+//doc see motion.c
+void motion_record(arm_id_t arm, const uint8_t* from, const uint8_t* to, const uint32_t* arrived);
+TickType_t motion_predict(arm_id_t arm, const uint8_t* from, const uint8_t* to);
+void motion_export(arm_id_t arm);
+void motion_init();
+
+#endif /* MOTION_H */
@@ -0,0 +1,335 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup sdlog SD Log
+ * @brief Persistent log sink which appends all log messages to a rotating file on the sd card
+ */
+/*@{*/
+
+#include "sdlog.h"
+#include "loglevel.h"
+#include <FreeRTOS.h>
+#include <stdio.h>
+#include <task.h>
+#include <semphr.h>
+#include <string.h>
+#include <ff.h>
+#include <rtc.h>
+
+// -------------------- Configuration  ------------
+#define STACKSIZE_TASK        ( 512 ) //!< Stack size of the sd log task (FatFs needs some room)
+#define PRIORITY_TASK         ( 1 ) //!< Priority of the sd log task. Lowest, so that card io never delays a control task
+
+#define SDLOG_BUFFER_SIZE     4096 //!< Size of one write buffer. Must be a multiple of the sector size (512)
+#define SDLOG_RECORD_SIZE     128 //!< Maximum length of a single formatted record
+#define SDLOG_FLUSH_TIMEOUT   5000 //!< Time in ticks after which a partially filled buffer is written anyway
+#define SDLOG_STATS_INTERVAL  10000 //!< Interval in ticks over which the record rate is measured
+#define SDLOG_MOUNT_RETRY     5000 //!< Time in ticks to wait before the card is mounted again after an error
+#define SDLOG_MAX_FILE_SIZE   (1024UL*1024UL) //!< Size in bytes after which the next log file is started
+#define SDLOG_MAX_FILES       8 //!< Number of log files to rotate through
+
+
+// ------------------ Implementation ------------------------
+
+static uint8_t sdlog_buffer[2][SDLOG_BUFFER_SIZE] __attribute__((aligned(4))); //!< Double buffer. One is filled by the callers, the other one is written to the card
+static uint16_t sdlog_fill[2]; //!< Number of bytes used in each buffer
+static uint8_t sdlog_active; //!< Index of the buffer that is currently filled
+static uint16_t sdlog_start; //!< File offset of the active buffer, modulo \ref SDLOG_BUFFER_SIZE
+static volatile bool sdlog_pending; //!< Whether the inactive buffer still waits to be written
+static volatile bool sdlog_ready; //!< Whether the card is mounted and a log file is open
+
+static FATFS sdlog_fs; //!< FatFs work area of the sd card
+static FIL sdlog_file; //!< Currently open log file
+static uint8_t sdlog_file_index; //!< Index of the currently open log file
+
+static sdlog_stats_t sdlog_stats; //!< Statistics, protected by sdlog_mutex
+static SemaphoreHandle_t sdlog_mutex; //!< Mutex to ensure atomic operations on the buffers and statistics
+static TaskHandle_t sdlog_task_handle; //!< Handle of the writer task, used to notify it about full buffers
+
+
+/**
+ * @brief       Generates the file name of a log file
+ * @type        static
+ * @param[out]  name    Buffer for the file name (at least 13 chars)
+ * @param[in]   index   Index of the log file
+ * @return      None
+ **/
+static void sdlog_file_name(char* name, uint8_t index)
+{
+    sprintf(name, "UBOR%u.LOG", index);
+}
+
+/**
+ * @brief       Makes the other buffer the active one. Must be called with sdlog_mutex taken and no buffer pending.
+ * @type        static
+ * @return      None
+ **/
+static void sdlog_swap(void)
+{
+    sdlog_start = (sdlog_start + sdlog_fill[sdlog_active]) % SDLOG_BUFFER_SIZE;
+    sdlog_active ^= 1;
+    sdlog_pending = true;
+}
+
+/**
+ * @brief       Mounts the card and opens the log file which is either unused or the oldest one
+ * @type        static
+ * @return      True if successful
+ **/
+static bool sdlog_open(void)
+{
+    char name[13];
+    FILINFO info;
+    uint32_t oldest = 0xFFFFFFFF;
+
+    if(f_mount(&sdlog_fs, "", 1) != FR_OK) {
+        return false;
+    }
+
+    /* Pick the first unused file, or overwrite the oldest one */
+    sdlog_file_index = 0;
+    for(uint8_t i = 0; i < SDLOG_MAX_FILES; i++) {
+        sdlog_file_name(name, i);
+        if(f_stat(name, &info) != FR_OK) {
+            sdlog_file_index = i;
+            break;
+        }
+        uint32_t stamp = ((uint32_t)info.fdate << 16) | info.ftime;
+        if(stamp < oldest) {
+            oldest = stamp;
+            sdlog_file_index = i;
+        }
+    }
+
+    sdlog_file_name(name, sdlog_file_index);
+    if(f_open(&sdlog_file, name, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        return false;
+    }
+
+    xSemaphoreTake(sdlog_mutex, portMAX_DELAY);
+    sdlog_fill[0] = 0;
+    sdlog_fill[1] = 0;
+    sdlog_start = 0;
+    sdlog_pending = false;
+    xSemaphoreGive(sdlog_mutex);
+
+    return true;
+}
+
+/**
+ * @brief       Closes the current log file and continues with the next one
+ * @type        static
+ * @return      True if successful
+ **/
+static bool sdlog_rotate(void)
+{
+    char name[13];
+
+    f_close(&sdlog_file);
+    sdlog_file_index = (sdlog_file_index + 1) % SDLOG_MAX_FILES;
+    sdlog_file_name(name, sdlog_file_index);
+
+    return f_open(&sdlog_file, name, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK;
+}
+
+/**
+ * @brief       Writes the pending buffer to the card
+ * @type        static
+ * @return      True if successful
+ **/
+static bool sdlog_flush(void)
+{
+    uint8_t index = sdlog_active ^ 1;
+    UINT written = 0;
+
+    FRESULT res = f_write(&sdlog_file, sdlog_buffer[index], sdlog_fill[index], &written);
+    if(res == FR_OK) {
+        res = f_sync(&sdlog_file);
+    }
+    bool ok = res == FR_OK && written == sdlog_fill[index];
+
+    xSemaphoreTake(sdlog_mutex, portMAX_DELAY);
+    sdlog_stats.bytes_written += written;
+    sdlog_fill[index] = 0;
+    sdlog_pending = false;
+    xSemaphoreGive(sdlog_mutex);
+
+    /* Only rotate on a buffer boundary, so that the writes to the new file stay aligned */
+    if(ok && f_size(&sdlog_file) >= SDLOG_MAX_FILE_SIZE && f_tell(&sdlog_file) % SDLOG_BUFFER_SIZE == 0) {
+        ok = sdlog_rotate();
+    }
+
+    return ok;
+}
+
+/**
+ * @brief       Appends a timestamped record to the log. Never waits on card io: If both buffers are busy, the record is dropped.
+ * @type        global
+ * @param[in]   taskname    Name of the task that wrote the message
+ * @param[in]   message     Message to store
+ * @return      True if the record was accepted
+ **/
+bool sdlog_write(const char* taskname, const char* message)
+{
+    char record[SDLOG_RECORD_SIZE]; //Buffer for record. must be on stack (multi-task env)
+    CARME_RTC_TIME_t time;
+
+    if(!sdlog_ready) {
+        return false;
+    }
+
+    CARME_RTC_GetTime(&time);
+    int length = snprintf(record, sizeof(record), "20%02u-%02u-%02u %02u:%02u:%02u %10lu %s: %s\r\n",
+                          time.year, time.month, time.day, time.hour, time.min, time.sec,
+                          (unsigned long)xTaskGetTickCount(), taskname, message);
+    if(length < 0) {
+        return false;
+    }
+    if(length >= sizeof(record)) { //truncated, but keep the line ending
+        length = sizeof(record) - 1;
+        record[length - 1] = '\n';
+    }
+
+    bool accepted = true;
+    bool notify = false;
+
+    xSemaphoreTake(sdlog_mutex, portMAX_DELAY);
+
+    uint16_t space = SDLOG_BUFFER_SIZE - sdlog_start - sdlog_fill[sdlog_active];
+    if(length >= space && sdlog_pending) {
+        sdlog_stats.dropped++;
+        accepted = false;
+    } else {
+        /* Fill the active buffer up to the boundary and continue in the other one */
+        uint16_t part = length > space ? space : length;
+        memcpy(&sdlog_buffer[sdlog_active][sdlog_fill[sdlog_active]], record, part);
+        sdlog_fill[sdlog_active] += part;
+
+        if(part == space) {
+            sdlog_swap();
+            notify = true;
+            memcpy(sdlog_buffer[sdlog_active], &record[part], length - part);
+            sdlog_fill[sdlog_active] = length - part;
+        }
+        sdlog_stats.records++;
+    }
+
+    xSemaphoreGive(sdlog_mutex);
+
+    if(notify) {
+        xTaskNotifyGive(sdlog_task_handle);
+    }
+
+    return accepted;
+}
+
+/**
+ * @brief       Returns a copy of the current sink statistics
+ * @type        global
+ * @param[out]  stats   Buffer for the statistics
+ * @return      None
+ **/
+void sdlog_get_stats(sdlog_stats_t* stats)
+{
+    xSemaphoreTake(sdlog_mutex, portMAX_DELAY);
+    memcpy(stats, &sdlog_stats, sizeof(sdlog_stats_t));
+    xSemaphoreGive(sdlog_mutex);
+}
+
+/**
+ * @brief       Writer task, writes full buffers to the card and measures the record rate
+ * @type        static
+ * @param[in]   pv_data     Not used
+ * @return      None
+ **/
+static void sdlog_task(void *pv_data)
+{
+    TickType_t stats_time = xTaskGetTickCount();
+    uint32_t stats_records = 0;
+    uint32_t stats_dropped = 0;
+    uint8_t stats_line = DISPLAY_NEWLINE;
+
+    while(true) {
+        if(!sdlog_ready) {
+            sdlog_ready = sdlog_open();
+            if(!sdlog_ready) {
+                vTaskDelay(SDLOG_MOUNT_RETRY);
+                continue;
+            }
+            LOG(DISPLAY, LOG_INFO, DISPLAY_NEWLINE, "Logging to UBOR%u.LOG", sdlog_file_index);
+        }
+
+        /* Wait on a full buffer. On timeout, write the partially filled one */
+        if(ulTaskNotifyTake(pdTRUE, SDLOG_FLUSH_TIMEOUT) == 0) {
+            xSemaphoreTake(sdlog_mutex, portMAX_DELAY);
+            if(!sdlog_pending && sdlog_fill[sdlog_active] > 0) {
+                sdlog_swap();
+            }
+            xSemaphoreGive(sdlog_mutex);
+        }
+
+        if(sdlog_pending && !sdlog_flush()) {
+            sdlog_ready = false;
+            f_close(&sdlog_file);
+            LOG(DISPLAY, LOG_ERROR, DISPLAY_NEWLINE, "SD card write failed");
+            continue;
+        }
+
+        /* Measure the sustained record rate */
+        TickType_t now = xTaskGetTickCount();
+        if(now - stats_time >= SDLOG_STATS_INTERVAL) {
+            sdlog_stats_t stats;
+
+            xSemaphoreTake(sdlog_mutex, portMAX_DELAY);
+            sdlog_stats.records_per_sec = (sdlog_stats.records - stats_records) * configTICK_RATE_HZ / (now - stats_time);
+            if(sdlog_stats.dropped == stats_dropped && sdlog_stats.records_per_sec > sdlog_stats.max_records_per_sec) {
+                sdlog_stats.max_records_per_sec = sdlog_stats.records_per_sec;
+            }
+            stats_records = sdlog_stats.records;
+            stats_dropped = sdlog_stats.dropped;
+            memcpy(&stats, &sdlog_stats, sizeof(sdlog_stats_t)); //the log below runs without the mutex
+            xSemaphoreGive(sdlog_mutex);
+            stats_time = now;
+
+            stats_line = LOG(DISPLAY, LOG_INFO, stats_line, "SD log: %lu rec/s (max %lu), %lu dropped",
+                                     stats.records_per_sec, stats.max_records_per_sec, stats.dropped);
+        }
+    }
+}
+
+/**
+ * @brief       Initializes the sd log sink and starts the writer task. The card is mounted by the task.
+ * @type        global
+ * @return      None
+ **/
+void sdlog_init()
+{
+    sdlog_mutex = xSemaphoreCreateMutex();
+    sdlog_ready = false;
+
+    xTaskCreate(sdlog_task,
+                "SD Log",
+                STACKSIZE_TASK,
+                NULL,
+                PRIORITY_TASK,
+                &sdlog_task_handle);
+}
+
+/*@}*/
@@ -0,0 +1,23 @@
+#ifndef SDLOG_H
+#define SDLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Statistics of the sd card log sink
+ */
+typedef struct {
+    uint32_t records; //!< Number of records accepted by the sink
+    uint32_t dropped; //!< Number of records dropped because both buffers were busy
+    uint32_t bytes_written; //!< Number of bytes written to the card
+    uint32_t records_per_sec; //!< Record rate measured over the last statistic interval
+    uint32_t max_records_per_sec; //!< Highest record rate that was sustained without drops
+} sdlog_stats_t;
+
+//doc see sdlog.c
+bool sdlog_write(const char* taskname, const char* message);
+void sdlog_get_stats(sdlog_stats_t* stats);
+void sdlog_init();
+
+#endif /* SDLOG_H */
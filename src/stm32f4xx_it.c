@@ -45,6 +45,7 @@ extern "C" {
 #include <carme.h>					/* CARME Module							*/
 #include <can.h>					/* CARME CAN Module						*/
 #include "stm32f4xx_it.h"
+#include "telemetry.h"
 
 /*----- Macros -------------------------------------------------------------*/
 
@@ -148,6 +149,11 @@ void EXTI9_5_IRQHandler(void)
     }
 }
 
+void DMA1_Stream3_IRQHandler(void)
+{
+    telemetry_dma_handler();
+}
+
 #ifdef __cplusplus
 }
 #endif
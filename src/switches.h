@@ -0,0 +1,35 @@
+#ifndef SWITCHES_H
+#define SWITCHES_H
+
+/*
+ * DIP switches of the CARME IO1 board, one bit per switch (switch 1 is bit 0). All modules which read the
+ * switches take their bits from here, so that no switch is used twice by accident:
+ *
+ *   Bit   Switch  Module  Meaning
+ *   0x01  1       bcs     manual direction of the dispatcher
+ *                 arm     manual arm movement: left arm selected (right when off)
+ *   0x02  2       bcs     direction in manual mode (on: left)
+ *                 arm     manual arm movement: the buttons increment the joints (decrement when off)
+ *   0x04  3       arm     manual arm movement: gripper open
+ *   0x08  4       arm     manual arm movement: teach mode
+ *   0x10  5       arm     manual arm movement: take the selected arm over from its task
+ *   0x20  6       bcs     adaptive dispatcher
+ *   0x40  7       bcs     after a lost block wait for the operator (button T3)
+ *   0x80  8       display dashboard instead of the log
+ *
+ * Switches 1 and 2 are shared: while an arm is moved by hand, they also set the policy of the dispatcher.
+ * The log levels are set over CAN only, see \ref loglevel.
+ */
+
+#define SWITCH_MANUAL           0x01 //!< DIP switch 1: manual direction selection of the dispatcher
+#define SWITCH_DIRECTION        0x02 //!< DIP switch 2: direction in manual mode (on: first target of the dispatcher, i.e. left)
+#define SWITCH_ARM_LEFT         0x01 //!< DIP switch 1: the manual arm movement controls the left arm (off: the right arm)
+#define SWITCH_ARM_INCREMENT    0x02 //!< DIP switch 2: the buttons of the manual arm movement increment the joints (off: decrement)
+#define SWITCH_ARM_GRIPPER      0x04 //!< DIP switch 3: gripper of the manually moved arm (on: open)
+#define SWITCH_ARM_TEACH        0x08 //!< DIP switch 4: teach mode of the manual arm movement
+#define SWITCH_ARM_MANUAL       0x10 //!< DIP switch 5: manual arm movement, the selected arm is taken over from its task
+#define SWITCH_ADAPTIVE         0x20 //!< DIP switch 6: direction by downstream load
+#define SWITCH_RECOVERY_ACK     0x40 //!< DIP switch 7: after a lost block, the belt waits until the operator pressed button T3
+#define SWITCH_DASHBOARD        0x80 //!< DIP switch 8: the display shows the dashboard instead of the log
+
+#endif /* SWITCHES_H */
@@ -0,0 +1,348 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup teach Teach-in
+ * @brief Stores the waypoints of all arms in the on-board EEPROM and loads them at start-up
+ *
+ * The waypoints of the \ref topology are compiled in as defaults. With the manual arm movement
+ * a waypoint can be replaced by the current position of an arm (\ref teach_capture) and all waypoints
+ * are written to the EEPROM (\ref teach_save). At start-up \ref teach_init loads them back into RAM,
+ * so a path can be retuned without a reflash. The waypoint tables are written while the arm tasks run,
+ * so the arm tasks read them with \ref teach_get_waypoint, under the same lock. A waypoint which differs
+ * from the compiled-in default is marked as taught (\ref teach_is_taught).
+ *
+ * The image consists of a header word (magic and number of waypoint bytes), the waypoints of all arms
+ * and a CRC32 calculated by the CRC unit. An image which does not match the topology (other number
+ * of waypoints) or has a wrong CRC is ignored and the defaults are used.
+ *
+ * The EEPROM behind the image (from \ref TEACH_RECORD_BASE) holds the records of other modules, which are
+ * written with \ref teach_store and checked by the same CRC (\ref teach_load).
+ */
+/*@{*/
+
+#include "teach.h"
+#include "loglevel.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include <string.h>
+#include <eeprom.h>
+#include <stm32f4xx_rcc.h>
+#include <stm32f4xx_crc.h>
+
+// -------------------- Configuration  ------------
+#define TEACH_EEPROM_BASE     0x00 //!< First EEPROM address of the image
+#define TEACH_EEPROM_SIZE     256 //!< EEPROM bytes which can be addressed by the BSP (8 bit addresses)
+#define TEACH_IMAGE_SIZE      TEACH_RECORD_BASE //!< EEPROM bytes of the waypoint image
+#define TEACH_PAGE_SIZE       16 //!< Bytes per read and write. A write must not cross a page of the EEPROM
+#define TEACH_MAGIC           0x7EAC //!< Upper half of the header word of a valid image
+#define TEACH_MAX_WAYPOINTS   32 //!< Waypoints per arm which can be marked as taught
+
+
+// ------------------ Implementation ------------------------
+
+#define TEACH_IMAGE_WORDS     (TEACH_IMAGE_SIZE / sizeof(uint32_t)) //!< Size of the image buffer
+
+static uint32_t teach_image[TEACH_IMAGE_WORDS]; //!< Image as it is stored in the EEPROM: header, waypoints, CRC
+static SemaphoreHandle_t teach_mutex; //!< Serializes the EEPROM and the CRC unit between the image and the records
+static uint32_t teach_taught[TOPOLOGY_MAX_ARMS]; //!< One bit per waypoint of each arm which differs from the compiled-in default
+
+
+/**
+ * @brief       Returns the number of waypoint bytes of all arms of the topology
+ * @type        static
+ * @return      The number of bytes
+ **/
+static uint16_t teach_waypoint_bytes()
+{
+    uint16_t bytes = 0;
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        bytes += topology_arms[arm].waypoint_count * TOPOLOGY_AXES;
+    }
+    return bytes;
+}
+
+/**
+ * @brief       Returns the number of words of the image without the CRC
+ * @type        static
+ * @param[in]   bytes   Number of waypoint bytes
+ * @return      The number of words
+ **/
+static uint16_t teach_image_words(uint16_t bytes)
+{
+    return 1 + (bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+}
+
+/**
+ * @brief       Calculates the CRC of a buffer with the CRC unit. Must be called with the teach_mutex taken.
+ * @type        static
+ * @param[in]   data    The buffer
+ * @param[in]   words   Number of words to include
+ * @return      The CRC
+ **/
+static uint32_t teach_crc(uint32_t* data, uint16_t words)
+{
+    CRC_ResetDR();
+    return CRC_CalcBlockCRC(data, words);
+}
+
+/**
+ * @brief       Reads or writes a buffer page by page. Must be called with the teach_mutex taken.
+ * @type        static
+ * @param[in]   write   true to write the buffer to the EEPROM, false to read it
+ * @param[in]   address First EEPROM address (page aligned)
+ * @param[in,out] data  The buffer
+ * @param[in]   length  Number of bytes to transfer
+ * @return      true on success
+ **/
+static bool teach_transfer(bool write, uint16_t address, uint8_t* data, uint16_t length)
+{
+    for(uint16_t offset = 0; offset < length; offset += TEACH_PAGE_SIZE) {
+        uint8_t count = length - offset < TEACH_PAGE_SIZE ? length - offset : TEACH_PAGE_SIZE;
+        ERROR_CODES error;
+
+        if(write) {
+            error = CARME_EEPROM_Write(&data[offset], count, address + offset);
+            vTaskDelay(CARME_EEPROM_WRITE_DELAY); //the EEPROM is busy until the page is written
+        } else {
+            error = CARME_EEPROM_Read(&data[offset], count, address + offset);
+        }
+        if(error != CARME_NO_ERROR) {
+            LOG(ARM, LOG_ERROR, DISPLAY_NEWLINE, "EEPROM %s failed at %u (%u)", write ? "write" : "read", address + offset, error);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief       Reads the image from the EEPROM and checks it against the topology. Must be called with the teach_mutex taken.
+ * @type        static
+ * @param[in]   bytes   Number of waypoint bytes of the topology
+ * @return      true if the image is valid
+ **/
+static bool teach_read(uint16_t bytes)
+{
+    uint16_t words = teach_image_words(bytes);
+
+    if(!teach_transfer(false, TEACH_EEPROM_BASE, (uint8_t*)teach_image, (words + 1) * sizeof(uint32_t))) {
+        return false;
+    }
+    if(teach_image[0] != ((uint32_t)TEACH_MAGIC << 16 | bytes)) {
+        LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "No taught waypoints, using defaults");
+        return false;
+    }
+    if(teach_image[words] != teach_crc(teach_image, words)) {
+        LOG(ARM, LOG_WARN, DISPLAY_NEWLINE, "Taught waypoints corrupt, using defaults");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief       Marks a waypoint as taught
+ * @type        static
+ * @param[in]   arm         Index of the arm in \ref topology_arms
+ * @param[in]   waypoint    Index of the waypoint
+ * @return      None
+ **/
+static void teach_mark(arm_id_t arm, uint8_t waypoint)
+{
+    if(waypoint < TEACH_MAX_WAYPOINTS) {
+        teach_taught[arm] |= 1UL << waypoint;
+    }
+}
+
+/**
+ * @brief       Returns whether a waypoint was taught, i.e. captured or loaded from the EEPROM with
+ *              another position than the compiled-in default
+ * @type        global
+ * @param[in]   arm         Index of the arm in \ref topology_arms
+ * @param[in]   waypoint    Index of the waypoint
+ * @return      true if the waypoint was taught
+ **/
+bool teach_is_taught(arm_id_t arm, uint8_t waypoint)
+{
+    return waypoint < TEACH_MAX_WAYPOINTS && (teach_taught[arm] & (1UL << waypoint)) != 0;
+}
+
+/**
+ * @brief       Copies a waypoint of an arm, consistent with a concurrent \ref teach_capture
+ * @type        global
+ * @param[in]   arm         Index of the arm in \ref topology_arms
+ * @param[in]   waypoint    Index of the waypoint
+ * @param[out]  position    The waypoint (\ref TOPOLOGY_AXES bytes)
+ * @return      None
+ **/
+void teach_get_waypoint(arm_id_t arm, uint8_t waypoint, uint8_t* position)
+{
+    taskENTER_CRITICAL();
+    memcpy(position, topology_arms[arm].waypoints[waypoint], TOPOLOGY_AXES);
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief       Replaces a waypoint of an arm by a position (in RAM only, see \ref teach_save).
+ *              The arm task uses the waypoint in its next cycle.
+ *              A taught grab or grip waypoint replaces the grasp pose of the block location.
+ * @type        global
+ * @param[in]   arm         Index of the arm in \ref topology_arms
+ * @param[in]   waypoint    Index of the waypoint
+ * @param[in]   position    Position reported by the arm (\ref TOPOLOGY_AXES bytes)
+ * @return      false if there is no such waypoint
+ **/
+bool teach_capture(arm_id_t arm, uint8_t waypoint, const uint8_t* position)
+{
+    if(arm >= topology_arm_count || waypoint >= topology_arms[arm].waypoint_count) {
+        return false;
+    }
+
+    taskENTER_CRITICAL(); //the arm task reads the waypoint with teach_get_waypoint
+    memcpy(topology_arms[arm].waypoints[waypoint], position, TOPOLOGY_AXES);
+    taskEXIT_CRITICAL();
+    teach_mark(arm, waypoint);
+
+    LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "%s wp%u: %x %x %x %x %x %x", topology_arms[arm].name, waypoint,
+        position[0], position[1], position[2], position[3], position[4], position[5]);
+    return true;
+}
+
+/**
+ * @brief       Writes the waypoints of all arms to the EEPROM and reads them back to verify them.
+ *              Blocks the calling task for some 100 ms.
+ * @type        global
+ * @return      true if the waypoints are stored
+ **/
+bool teach_save()
+{
+    uint16_t bytes = teach_waypoint_bytes();
+    uint16_t words = teach_image_words(bytes);
+    uint8_t* waypoints = (uint8_t*)&teach_image[1];
+
+    bool saved;
+
+    if((words + 1) * sizeof(uint32_t) > TEACH_IMAGE_SIZE) {
+        LOG(ARM, LOG_ERROR, DISPLAY_NEWLINE, "Waypoints do not fit into the EEPROM");
+        return false;
+    }
+
+    xSemaphoreTake(teach_mutex, portMAX_DELAY);
+    memset(teach_image, 0, sizeof(teach_image));
+    teach_image[0] = (uint32_t)TEACH_MAGIC << 16 | bytes;
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        uint16_t size = topology_arms[arm].waypoint_count * TOPOLOGY_AXES;
+        memcpy(waypoints, topology_arms[arm].waypoints, size);
+        waypoints += size;
+    }
+    teach_image[words] = teach_crc(teach_image, words);
+    saved = teach_transfer(true, TEACH_EEPROM_BASE, (uint8_t*)teach_image, (words + 1) * sizeof(uint32_t)) && teach_read(bytes);
+    xSemaphoreGive(teach_mutex);
+
+    if(!saved) {
+        LOG(ARM, LOG_ERROR, DISPLAY_NEWLINE, "Saving the waypoints failed");
+        return false;
+    }
+    LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "Saved %u waypoint bytes", bytes);
+    return true;
+}
+
+/**
+ * @brief       Reads a record of another module from the EEPROM and checks its CRC
+ * @type        global
+ * @param[in]   address First EEPROM address, from \ref TEACH_RECORD_BASE and page aligned
+ * @param[out]  record  The record
+ * @param[in]   words   Number of words of the record, the last one is the CRC
+ * @return      true if the record is valid
+ **/
+bool teach_load(uint16_t address, uint32_t* record, uint16_t words)
+{
+    bool valid;
+
+    if(address < TEACH_RECORD_BASE || address + words * sizeof(uint32_t) > TEACH_EEPROM_SIZE || words < 2) {
+        return false;
+    }
+
+    xSemaphoreTake(teach_mutex, portMAX_DELAY);
+    valid = teach_transfer(false, address, (uint8_t*)record, words * sizeof(uint32_t)) &&
+            record[words - 1] == teach_crc(record, words - 1);
+    xSemaphoreGive(teach_mutex);
+    return valid;
+}
+
+/**
+ * @brief       Writes a record of another module to the EEPROM and reads it back to verify it.
+ *              Blocks the calling task for 10 ms per 16 bytes.
+ * @type        global
+ * @param[in]   address First EEPROM address, from \ref TEACH_RECORD_BASE and page aligned
+ * @param[in,out] record The record, the CRC is stored in the last word (the record holds the read back data afterwards)
+ * @param[in]   words   Number of words of the record, including the CRC
+ * @return      true if the record is stored
+ **/
+bool teach_store(uint16_t address, uint32_t* record, uint16_t words)
+{
+    bool written;
+
+    if(address < TEACH_RECORD_BASE || address + words * sizeof(uint32_t) > TEACH_EEPROM_SIZE || words < 2) {
+        return false;
+    }
+
+    xSemaphoreTake(teach_mutex, portMAX_DELAY);
+    record[words - 1] = teach_crc(record, words - 1);
+    written = teach_transfer(true, address, (uint8_t*)record, words * sizeof(uint32_t));
+    xSemaphoreGive(teach_mutex);
+
+    return written && teach_load(address, record, words);
+}
+
+/**
+ * @brief       Enables the CRC unit and loads the taught waypoints from the EEPROM into the topology.
+ *              Must be called before the arm tasks are created.
+ * @type        global
+ * @return      None
+ **/
+void teach_init()
+{
+    uint16_t bytes = teach_waypoint_bytes();
+
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_CRC, ENABLE);
+    teach_mutex = xSemaphoreCreateMutex();
+
+    if((teach_image_words(bytes) + 1) * sizeof(uint32_t) > TEACH_IMAGE_SIZE) {
+        LOG(ARM, LOG_ERROR, DISPLAY_NEWLINE, "Waypoints do not fit into the EEPROM");
+        return;
+    }
+    if(!teach_read(bytes)) { //no other task runs yet, the mutex is not needed
+        return;
+    }
+
+    const uint8_t* waypoints = (const uint8_t*)&teach_image[1];
+    for(arm_id_t arm = 0; arm < topology_arm_count; arm++) {
+        for(uint8_t n = 0; n < topology_arms[arm].waypoint_count; n++) {
+            if(memcmp(topology_arms[arm].waypoints[n], waypoints, TOPOLOGY_AXES) != 0) {
+                memcpy(topology_arms[arm].waypoints[n], waypoints, TOPOLOGY_AXES);
+                teach_mark(arm, n);
+            }
+            waypoints += TOPOLOGY_AXES;
+        }
+    }
+    LOG(ARM, LOG_INFO, DISPLAY_NEWLINE, "Loaded taught waypoints");
+}
+
+/*@}*/
@@ -0,0 +1,19 @@
+#ifndef TEACH_H
+#define TEACH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "topology.h"
+
+#define TEACH_RECORD_BASE     0xA0 //!< First EEPROM address behind the waypoint image, for the records of other modules
+
+//doc see teach.c
+bool teach_capture(arm_id_t arm, uint8_t waypoint, const uint8_t* position);
+void teach_get_waypoint(arm_id_t arm, uint8_t waypoint, uint8_t* position);
+bool teach_is_taught(arm_id_t arm, uint8_t waypoint);
+bool teach_save();
+bool teach_load(uint16_t address, uint32_t* record, uint16_t words);
+bool teach_store(uint16_t address, uint32_t* record, uint16_t words);
+void teach_init();
+
+#endif /* TEACH_H */
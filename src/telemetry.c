@@ -0,0 +1,288 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup telemetry Telemetry
+ * @brief Streams log records and ucan statistics as binary frames over the uart, using dma
+ *
+ * Frame layout: <tt>0xA5 | type | seq | len | payload[len] | crc8</tt>. The crc (polynomial 0x07)
+ * covers type, seq, len and the payload. Multibyte values are little endian.
+ * The host side decoder is utils/telemetry_decode.py.
+ */
+/*@{*/
+
+#include "telemetry.h"
+#include "ucan.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <string.h>
+#include <uart.h>
+#include <stm32f4xx_dma.h>
+#include <stm32f4xx_usart.h>
+
+// -------------------- Configuration  ------------
+#define STACKSIZE_TASK        ( 256 ) //!< Stack size of the telemetry task
+#define PRIORITY_TASK         ( 1 ) //!< Priority of the telemetry task
+
+#define TELEMETRY_UART          CARME_UART1 //!< Uart to stream to (USART3, UART0 is used by printf)
+#define TELEMETRY_BAUDRATE      921600 //!< Baudrate of the stream
+#define TELEMETRY_DMA_STREAM    DMA1_Stream3 //!< Dma stream connected to USART3_TX
+#define TELEMETRY_DMA_CHANNEL   DMA_Channel_4 //!< Dma channel of USART3_TX on that stream
+#define TELEMETRY_DMA_IT_TC     DMA_IT_TCIF3 //!< Transfer complete interrupt of that stream
+#define TELEMETRY_DMA_IRQ       DMA1_Stream3_IRQn //!< Interrupt of that stream
+#define TELEMETRY_IRQ_PRIORITY  6 //!< Must not be more urgent than configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, the irq is masked by critical sections
+
+#define TELEMETRY_BUFFER_SIZE   2048 //!< Size of the transmit ring buffer
+#define TELEMETRY_MAX_PAYLOAD   96 //!< Maximum payload of a single frame
+#define TELEMETRY_STATS_INTERVAL 1000 //!< Interval in ticks between two statistic frames
+
+#define TELEMETRY_SOF           0xA5 //!< Start of frame marker
+
+
+// ------------------ Implementation ------------------------
+
+static uint8_t telemetry_buffer[TELEMETRY_BUFFER_SIZE]; //!< Transmit ring buffer
+static volatile uint16_t telemetry_head; //!< Position where the next frame is written to
+static volatile uint16_t telemetry_tail; //!< Position of the first byte that has not been sent yet
+static volatile uint16_t telemetry_dma_length; //!< Number of bytes in the running dma transfer (0 if idle)
+static uint8_t telemetry_seq; //!< Sequence number of the next frame (lets the host detect lost frames)
+static uint32_t telemetry_dropped; //!< Number of frames dropped because the ring buffer was full
+
+
+/**
+ * @brief       Calculates the crc8 (polynomial 0x07) of a buffer
+ * @type        static
+ * @param[in]   data    Data to calculate the crc of
+ * @param[in]   length  Number of bytes
+ * @return      crc8
+ **/
+static uint8_t telemetry_crc8(const uint8_t* data, uint16_t length)
+{
+    uint8_t crc = 0;
+    while(length--) {
+        crc ^= *data++;
+        for(uint8_t i = 0; i < 8; i++) {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief       Starts a dma transfer of the largest contiguous block of unsent data. Must be called with the dma irq masked.
+ * @type        static
+ * @return      None
+ **/
+static void telemetry_start_dma(void)
+{
+    uint16_t head = telemetry_head;
+    uint16_t length = head >= telemetry_tail ? head - telemetry_tail : TELEMETRY_BUFFER_SIZE - telemetry_tail;
+
+    telemetry_dma_length = length;
+    if(length == 0) {
+        return;
+    }
+
+    DMA_MemoryTargetConfig(TELEMETRY_DMA_STREAM, (uint32_t)&telemetry_buffer[telemetry_tail], DMA_Memory_0);
+    DMA_SetCurrDataCounter(TELEMETRY_DMA_STREAM, length);
+    DMA_Cmd(TELEMETRY_DMA_STREAM, ENABLE);
+}
+
+/**
+ * @brief       Dma transfer complete handler. Releases the sent data and starts the next transfer. Call from DMA1_Stream3_IRQHandler.
+ * @type        global
+ * @return      None
+ **/
+void telemetry_dma_handler(void)
+{
+    if(DMA_GetITStatus(TELEMETRY_DMA_STREAM, TELEMETRY_DMA_IT_TC) != RESET) {
+        DMA_ClearITPendingBit(TELEMETRY_DMA_STREAM, TELEMETRY_DMA_IT_TC);
+        telemetry_tail = (telemetry_tail + telemetry_dma_length) % TELEMETRY_BUFFER_SIZE;
+        telemetry_start_dma();
+    }
+}
+
+/**
+ * @brief       Queues a frame for transmission. Never waits: If the ring buffer is full, the frame is dropped.
+ * @type        global
+ * @param[in]   type    Frame type
+ * @param[in]   payload Payload of the frame
+ * @param[in]   length  Length of the payload (at most \ref TELEMETRY_MAX_PAYLOAD)
+ * @return      True if the frame was queued
+ **/
+bool telemetry_send(enum telemetry_type type, const uint8_t* payload, uint8_t length)
+{
+    uint8_t frame[TELEMETRY_MAX_PAYLOAD + 5]; //Buffer for frame. must be on stack (multi-task env)
+    uint16_t frame_length = length + 5;
+    bool queued = false;
+
+    if(length > TELEMETRY_MAX_PAYLOAD) {
+        return false;
+    }
+
+    frame[0] = TELEMETRY_SOF;
+    frame[1] = type;
+    frame[3] = length;
+    memcpy(&frame[4], payload, length);
+
+    taskENTER_CRITICAL();
+
+    uint16_t used = (telemetry_head - telemetry_tail + TELEMETRY_BUFFER_SIZE) % TELEMETRY_BUFFER_SIZE;
+    if(TELEMETRY_BUFFER_SIZE - 1 - used < frame_length) {
+        telemetry_dropped++;
+    } else {
+        frame[2] = telemetry_seq++;
+        frame[frame_length - 1] = telemetry_crc8(&frame[1], length + 3);
+
+        /* Copy frame into the ring buffer (in two parts, if it wraps around) */
+        uint16_t head = telemetry_head;
+        uint16_t part = TELEMETRY_BUFFER_SIZE - head;
+        if(part >= frame_length) {
+            memcpy(&telemetry_buffer[head], frame, frame_length);
+        } else {
+            memcpy(&telemetry_buffer[head], frame, part);
+            memcpy(telemetry_buffer, &frame[part], frame_length - part);
+        }
+        telemetry_head = (head + frame_length) % TELEMETRY_BUFFER_SIZE;
+
+        if(telemetry_dma_length == 0) {
+            telemetry_start_dma();
+        }
+        queued = true;
+    }
+
+    taskEXIT_CRITICAL();
+
+    return queued;
+}
+
+/**
+ * @brief       Streams a log record
+ * @type        global
+ * @param[in]   taskname    Name of the task that wrote the message
+ * @param[in]   message     Message to stream (truncated if it does not fit into a frame)
+ * @return      True if the frame was queued
+ **/
+bool telemetry_log_record(const char* taskname, const char* message)
+{
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+    uint32_t tick = xTaskGetTickCount();
+    uint8_t length = sizeof(tick);
+
+    memcpy(payload, &tick, sizeof(tick));
+
+    size_t name_length = strlen(taskname) + 1; //including terminator
+    memcpy(&payload[length], taskname, name_length);
+    length += name_length;
+
+    size_t message_length = strlen(message);
+    if(message_length > TELEMETRY_MAX_PAYLOAD - length) {
+        message_length = TELEMETRY_MAX_PAYLOAD - length;
+    }
+    memcpy(&payload[length], message, message_length);
+    length += message_length;
+
+    return telemetry_send(telemetry_log, payload, length);
+}
+
+/**
+ * @brief       Telemetry task, periodically streams the ucan statistics
+ * @type        static
+ * @param[in]   pv_data     Not used
+ * @return      None
+ **/
+static void telemetry_task(void *pv_data)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    ucan_stats_t stats;
+    uint32_t payload[6];
+
+    while(true) {
+        vTaskDelayUntil(&last_wake, TELEMETRY_STATS_INTERVAL);
+
+        ucan_get_stats(&stats);
+        payload[0] = xTaskGetTickCount();
+        payload[1] = stats.sent;
+        payload[2] = stats.received;
+        payload[3] = stats.dispatched;
+        payload[4] = stats.dropped;
+        payload[5] = telemetry_dropped;
+        telemetry_send(telemetry_ucan_stats, (uint8_t*)payload, sizeof(payload));
+    }
+}
+
+/**
+ * @brief       Initializes the uart and dma and starts the telemetry task
+ * @type        global
+ * @return      None
+ **/
+void telemetry_init()
+{
+    USART_InitTypeDef usart;
+    DMA_InitTypeDef dma;
+    NVIC_InitTypeDef nvic;
+
+    /* Uart */
+    usart.USART_BaudRate = TELEMETRY_BAUDRATE;
+    usart.USART_WordLength = USART_WordLength_8b;
+    usart.USART_StopBits = USART_StopBits_1;
+    usart.USART_Parity = USART_Parity_No;
+    usart.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
+    usart.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+    CARME_UART_GPIO_Init();
+    CARME_UART_Init(TELEMETRY_UART, &usart);
+    USART_DMACmd(TELEMETRY_UART, USART_DMAReq_Tx, ENABLE);
+
+    /* Dma: memory to uart, one transfer per contiguous block of the ring buffer */
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1, ENABLE);
+    DMA_DeInit(TELEMETRY_DMA_STREAM);
+    DMA_StructInit(&dma);
+    dma.DMA_Channel = TELEMETRY_DMA_CHANNEL;
+    dma.DMA_PeripheralBaseAddr = (uint32_t)&TELEMETRY_UART->DR;
+    dma.DMA_Memory0BaseAddr = (uint32_t)telemetry_buffer;
+    dma.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+    dma.DMA_BufferSize = 1;
+    dma.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    dma.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    dma.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    dma.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    dma.DMA_Mode = DMA_Mode_Normal;
+    dma.DMA_Priority = DMA_Priority_Low;
+    DMA_Init(TELEMETRY_DMA_STREAM, &dma);
+    DMA_ITConfig(TELEMETRY_DMA_STREAM, DMA_IT_TC, ENABLE);
+
+    nvic.NVIC_IRQChannel = TELEMETRY_DMA_IRQ;
+    nvic.NVIC_IRQChannelPreemptionPriority = TELEMETRY_IRQ_PRIORITY;
+    nvic.NVIC_IRQChannelSubPriority = 0;
+    nvic.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvic);
+
+    telemetry_head = 0;
+    telemetry_tail = 0;
+    telemetry_dma_length = 0;
+
+    xTaskCreate(telemetry_task,
+                "Telemetry",
+                STACKSIZE_TASK,
+                NULL,
+                PRIORITY_TASK,
+                NULL);
+}
+
+/*@}*/
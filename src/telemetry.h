@@ -0,0 +1,22 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Frame types of the telemetry stream. Keep in sync with utils/telemetry_decode.py
+ */
+enum telemetry_type {telemetry_log=0x01, //!< log record: tick, task name, message
+                     telemetry_ucan_stats=0x02, //!< ucan traffic counters: tick, sent, received, dispatched, dropped, dropped telemetry frames
+                     telemetry_metrics=0x03, //!< stage stats: tick, station, stage, count, sum, min, max, histogram (see metrics.c)
+                     telemetry_motion=0x04 //!< time model of an arm joint: tick, arm, joint, samples, offset, slope (see motion.c)
+                    };
+
+//doc see telemetry.c
+bool telemetry_send(enum telemetry_type type, const uint8_t* payload, uint8_t length);
+bool telemetry_log_record(const char* taskname, const char* message);
+void telemetry_dma_handler(void);
+void telemetry_init();
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,148 @@
+/*****************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ *
+ *****************************************************************************/
+
+/**
+ * @defgroup topology Topology
+ * @brief Configuration of the cell: belts, dispatchers, arms, their CAN ids and how the blocks flow between them
+ *
+ * bcs spawns one task per entry in \ref topology_belts, arm one task per entry in \ref topology_arms.
+ * Stations are referenced by their index in these tables. A belt either has a dispatcher, which pushes
+ * the blocks onto one of its targets, or an arm picks up the blocks at its end and drops them onto its target.
+ * To run a larger line, add the stations here (up to \ref TOPOLOGY_MAX_BELTS belts and \ref TOPOLOGY_MAX_ARMS arms).
+ */
+/*@{*/
+
+#include "topology.h"
+#include <stddef.h>
+
+// -------------------- Configuration  ------------
+
+/**
+ * @brief Dispatcher at the end of the mid belt
+ */
+static const topology_dispatcher_t dispatcher_mid = {
+    .can_id = 0x142,
+    .cmd_initial = {1, 0, 100},
+    .target_count = 2,
+    .targets = {BELT_LEFT, BELT_RIGHT},
+    .cmd_start = {{1, 0x1C, 100}, {1, 0xE4, 100}},
+    .cmd_move = {{1, 0xCE, 50}, {1, 0x32, 50}},
+};
+
+const topology_belt_t topology_belts[] = {
+    [BELT_LEFT]  = {"left",  0x110, false, NULL},
+    [BELT_MID]   = {"mid",   0x120, true,  &dispatcher_mid},
+    [BELT_RIGHT] = {"right", 0x130, false, NULL},
+};
+
+static uint8_t waypoints_left[][TOPOLOGY_AXES] = {
+    /*Arm    B     S     E     H     G */
+    {0x02, 0x00, 0x19, 0x1A, 0x21, 0x01}, //Warte Position ECTS Abholen
+    {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x01}, //ECTS Holen Mitte
+    {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x00}, //ECTS Greifen
+    {0x02, 0x00, 0x19, 0x1A, 0x21, 0x00}, //ECTS Anheben
+    {0x02, 0x12, 0x00, 0x40, 0x21, 0x00}, //Drehen bis pos 1
+    {0x02, 0x2D, 0x00, 0x2b, 0x21, 0x00}, //Drehen bis pos 2 bereit zum ablegen
+    {0x02, 0x2D, 0x1c, 0x1d, 0x21, 0x00}, //ECTS Ablegen
+    {0x02, 0x2D, 0x1c, 0x1d, 0x21, 0x01}, //ECTS Ablegen
+    {0x02, 0x2D, 0x13, 0x1d, 0x21, 0x01}, //Arm auserhalb ects
+    {0x02, 0x2D, 0x00, 0x36, 0x21, 0x01}, //Arm ausserhalb mitte
+    {0x02, 0x12, 0x00, 0x36, 0x21, 0x01}, //Arm ausserhalb mitte
+};
+
+static uint8_t waypoints_right[][TOPOLOGY_AXES] = {
+    /*                      Arm    B     S     E     H     G  */
+    /*0 Nullposition     */ {0x02, 0x00, 0x19, 0x1A, 0x21, 0x01},
+    /*1 StartPosition    */ {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x01},
+    /*2 Zp1 FB Links     */ {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x00},
+    /*3 Zp2 FB Links     */ {0x02, 0x00, 0x19, 0x1A, 0x21, 0x00},
+    /*4 G offen FB Links */ {0x02, 0xee, 0x00, 0x40, 0x21, 0x00},
+    /*5 G zu FB Links    */ {0x02, 0xD2, 0x00, 0x2b, 0x21, 0x00},
+    /*6 Zp1 FB Mitte     */ {0x02, 0xD2, 0x1c, 0x1d, 0x21, 0x00},
+    /*7 Zp2 FB Mitte     */ {0x02, 0xD2, 0x1c, 0x1d, 0x21, 0x01},
+    /*8 G zu FB Mitte    */ {0x02, 0xD2, 0x13, 0x1d, 0x21, 0x01},
+    /*9 G offen FB Mitte */ {0x02, 0xD2, 0x00, 0x36, 0x21, 0x01},
+    {0x02, 0xEE, 0x00, 0x36, 0x21, 0x01},
+};
+
+/*
+ * Airspace zones of each waypoint. The arms drop their blocks from opposite sides of the mid belt:
+ * only down at the belt they get into each other's way, once lifted each one stays above its half.
+ * The zones of a waypoint are held on the way to it and released when the arm arrived at the next one.
+ * The belt zone is held until the arm is fully lifted: waypoint 8 is a via-point which the arm only
+ * passes within ARM_BLEND_RADIUS (arm.c). Not measured on the cell yet, see AIRSPACE_EXCLUSIVE in airspace.c.
+ */
+static const uint8_t zones_left[] = {
+    0, 0, 0, 0, 0, 0,
+    TOPOLOGY_ZONE_BELT | TOPOLOGY_ZONE_LEFT, //ECTS Ablegen
+    TOPOLOGY_ZONE_BELT | TOPOLOGY_ZONE_LEFT, //ECTS Ablegen
+    TOPOLOGY_ZONE_BELT | TOPOLOGY_ZONE_LEFT, //Arm auserhalb ects
+    TOPOLOGY_ZONE_BELT | TOPOLOGY_ZONE_LEFT, //Arm ausserhalb mitte
+    0,
+};
+
+static const uint8_t zones_right[] = {
+    0, 0, 0, 0, 0, 0,
+    TOPOLOGY_ZONE_BELT | TOPOLOGY_ZONE_RIGHT, //6 Zp1 FB Mitte
+    TOPOLOGY_ZONE_BELT | TOPOLOGY_ZONE_RIGHT, //7 Zp2 FB Mitte
+    TOPOLOGY_ZONE_BELT | TOPOLOGY_ZONE_RIGHT, //8 G zu FB Mitte
+    TOPOLOGY_ZONE_BELT | TOPOLOGY_ZONE_RIGHT, //9 G offen FB Mitte
+    0,
+};
+
+/*
+ * Grasp poses by block location. Calibrate a location with the manual arm movement:
+ * place a block at that location, jog the arm until it grips the block and add the reported position.
+ * The centre is the grab waypoint. At the outer locations the base turns towards the block, the arms
+ * are mounted mirrored. These two poses are not measured on the cell yet, recalibrate them first.
+ */
+static const topology_grasp_t grasps_left[] = {
+    /*loc                     Arm    B     S     E     H     G */
+    {TOPOLOGY_LOCATION_MIN, {0x02, 0xFC, 0x1F, 0x1A, 0x21, 0x01}},
+    {0,                     {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x01}},
+    {TOPOLOGY_LOCATION_MAX, {0x02, 0x04, 0x1F, 0x1A, 0x21, 0x01}},
+};
+
+static const topology_grasp_t grasps_right[] = {
+    /*loc                     Arm    B     S     E     H     G */
+    {TOPOLOGY_LOCATION_MIN, {0x02, 0x04, 0x1F, 0x1A, 0x21, 0x01}},
+    {0,                     {0x02, 0x00, 0x1F, 0x1A, 0x21, 0x01}},
+    {TOPOLOGY_LOCATION_MAX, {0x02, 0xFC, 0x1F, 0x1A, 0x21, 0x01}},
+};
+
+const topology_arm_t topology_arms[] = {
+    [ARM_LEFT]  = {"Arm Left",  0x150, BELT_LEFT,  BELT_MID, waypoints_left,  sizeof(waypoints_left) / TOPOLOGY_AXES, zones_left,
+                   grasps_left, sizeof(grasps_left) / sizeof(topology_grasp_t)
+                  },
+    [ARM_RIGHT] = {"Arm Right", 0x160, BELT_RIGHT, BELT_MID, waypoints_right, sizeof(waypoints_right) / TOPOLOGY_AXES, zones_right,
+                   grasps_right, sizeof(grasps_right) / sizeof(topology_grasp_t)
+                  },
+};
+
+// ------------------ Implementation ------------------------
+
+const uint8_t topology_belt_count = sizeof(topology_belts) / sizeof(topology_belt_t);
+const uint8_t topology_arm_count = sizeof(topology_arms) / sizeof(topology_arm_t);
+
+_Static_assert(sizeof(topology_belts) / sizeof(topology_belt_t) <= TOPOLOGY_MAX_BELTS, "too many belts");
+_Static_assert(sizeof(topology_arms) / sizeof(topology_arm_t) <= TOPOLOGY_MAX_ARMS, "too many arms");
+_Static_assert(sizeof(zones_left) == sizeof(waypoints_left) / TOPOLOGY_AXES, "zones of each waypoint of the left arm");
+_Static_assert(sizeof(zones_right) == sizeof(waypoints_right) / TOPOLOGY_AXES, "zones of each waypoint of the right arm");
+
+/*@}*/
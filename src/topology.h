@@ -0,0 +1,79 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TOPOLOGY_MAX_BELTS      8 //!< Max number of belts of a cell
+#define TOPOLOGY_MAX_ARMS       6 //!< Max number of arms of a cell
+#define TOPOLOGY_MAX_TARGETS    4 //!< Max number of belts a dispatcher can push blocks to
+#define TOPOLOGY_AXES           6 //!< Bytes of an arm command (arm, base, shoulder, elbow, hand, gripper)
+#define TOPOLOGY_LOCATION_MIN   (-8) //!< Smallest block location reported by a belt (smaller values are clamped)
+#define TOPOLOGY_LOCATION_MAX   8 //!< Largest block location reported by a belt (larger values are clamped)
+
+/* Zones of the airspace above a target belt, see airspace.c. Zones held by different arms must not overlap in space */
+#define TOPOLOGY_ZONE_BELT      0x01 //!< Down at the belt, where the blocks are dropped
+#define TOPOLOGY_ZONE_LEFT      0x02 //!< Above the left half of the belt
+#define TOPOLOGY_ZONE_RIGHT     0x04 //!< Above the right half of the belt
+
+/* Stations of the default cell (indices into the tables) */
+#define BELT_LEFT   0 //!< the left belt
+#define BELT_MID    1 //!< the middle belt
+#define BELT_RIGHT  2 //!< the right belt
+#define ARM_LEFT    0 //!< the left arm
+#define ARM_RIGHT   1 //!< the right arm
+
+typedef uint8_t belt_id_t; //!< Index of a belt in \ref topology_belts
+typedef uint8_t arm_id_t; //!< Index of an arm in \ref topology_arms
+
+/**
+ * @brief Dispatcher at the end of a belt, which pushes the blocks onto one of its target belts
+ */
+typedef struct {
+    uint16_t can_id; //!< Id of the command message
+    uint8_t cmd_initial[3]; //!< Command to move to the initial position
+    uint8_t target_count; //!< Number of target belts
+    belt_id_t targets[TOPOLOGY_MAX_TARGETS]; //!< Belts the dispatcher can push to
+    uint8_t cmd_start[TOPOLOGY_MAX_TARGETS][3]; //!< Command to get ready for a target, before the block arrives
+    uint8_t cmd_move[TOPOLOGY_MAX_TARGETS][3]; //!< Command to push the block onto a target
+} topology_dispatcher_t;
+
+/**
+ * @brief A belt of the cell
+ */
+typedef struct {
+    const char* name; //!< Name of the task which controls the belt
+    uint16_t can_base; //!< Base id of the belt module (+0 status request, +1 status response, +2 command, +F reset)
+    bool feeder; //!< The blocks are placed onto this belt by hand at startup
+    const topology_dispatcher_t* dispatcher; //!< Dispatcher at the end of the belt, NULL if an arm picks up the blocks
+} topology_belt_t;
+
+/**
+ * @brief A calibrated grasp pose: where the arm grips a block at a certain location on its source belt
+ */
+typedef struct {
+    int8_t location; //!< Block location reported by the belt
+    uint8_t pose[TOPOLOGY_AXES]; //!< Pose of the arm (the gripper value is taken from the waypoints)
+} topology_grasp_t;
+
+/**
+ * @brief A robot arm of the cell, which moves blocks from one belt to another
+ */
+typedef struct {
+    const char* name; //!< Name of the task which controls the arm
+    uint16_t can_base; //!< Base id of the arm (+0 status request, +1 status response, +2 command, +F reset)
+    belt_id_t source; //!< Belt the arm takes its blocks from
+    belt_id_t target; //!< Belt the arm drops its blocks onto. Arms with the same target share the airspace above it
+    uint8_t (*waypoints)[TOPOLOGY_AXES]; //!< Waypoints of a cycle
+    uint8_t waypoint_count; //!< Number of waypoints of a cycle
+    const uint8_t* zones; //!< Zones of the airspace above the target which the arm occupies on its way to and at each waypoint
+    const topology_grasp_t* grasps; //!< Calibrated grasp poses, sorted by location. The poses in between are interpolated
+    uint8_t grasp_count; //!< Number of calibrated grasp poses, 0 to always grip at the grab waypoint
+} topology_arm_t;
+
+extern const topology_belt_t topology_belts[]; //!< All belts, see topology.c
+extern const uint8_t topology_belt_count; //!< Number of entries in \ref topology_belts
+extern const topology_arm_t topology_arms[]; //!< All arms, see topology.c
+extern const uint8_t topology_arm_count; //!< Number of entries in \ref topology_arms
+
+#endif /* TOPOLOGY_H */
@@ -29,6 +29,12 @@
 #define QUEUE_SIZE      10  // Length of the data queues
 #define STACKSIZE_TASK  256 // Stacksize for new tasks
 #define PRIORITY_TASK   2   // Taskpriority
+#define RX_IRQ_PRIORITY 6   // Priority of the CAN interrupt (must not be above configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY)
+#define RX_POLL_PERIOD  50  // Time in ticks after which the chip is read anyway (in case an interrupt got lost)
+#define TX_TIMEOUT      3   // Max time in ticks for a frame to be transmitted and acknowledged (a frame takes ~0.5 ms at 250 kBit/s)
+#define NODE_GAP        5   // Min time in ticks between two frames to the same node (the modules drop frames which follow closer)
+#define NODE_COUNT      128 // Number of nodes, a node are the upper 7 bits of the 11 bit id (e.g. 0x12x: mid belt)
+#define TX_DEFERRED     8   // Frames which wait on the gap of their node while frames to other nodes are sent
 
 /* ----- Datatypes -----------------------------------------------------------*/
 
@@ -41,9 +47,17 @@ typedef struct msg_link_s {
     uint16_t mask; //!< Mask for filtering rules
 } msg_link_t;
 
+/**
+ * @brief   Entry of the transmit queue
+ **/
+typedef struct ucan_tx_s {
+    CARME_CAN_MESSAGE msg; //!< The message to send
+    TaskHandle_t sender; //!< Task to notify when the message was transmitted, NULL if nobody waits
+} ucan_tx_t;
+
 /* ----- Globals ------------------------------------------------------------*/
 static CARME_CAN_MESSAGE rx_msg; //!< Message data object for incoming can messages
-static CARME_CAN_MESSAGE tx_msg; //!< Message data object for outgoing can messages
+static ucan_tx_t tx_frame; //!< Message data object for outgoing can messages
 
 static QueueHandle_t can_tx_queue; //!< Message queue for incoming can messages
 static QueueHandle_t can_rx_queue; //!< Message queue for outgoing can messages
@@ -51,13 +65,76 @@ static QueueHandle_t can_rx_queue; //!< Message queue for outgoing can messages
 static msg_link_t message_map[SIZE_MAP]; //!< Global message map
 static uint16_t n_message_map; //!< Size of the global message map
 
-static SemaphoreHandle_t can_semaphore; //!< Semaphore for can access
+static TaskHandle_t can_read_task; //!< Task which is notified on received messages
+static TaskHandle_t can_write_task; //!< Task which is notified on transmitted messages
+static TickType_t node_last_sent[NODE_COUNT]; //!< Time of the last frame to each node
+static ucan_tx_t tx_deferred[TX_DEFERRED]; //!< Frames taken from the transmit queue which wait on the gap of their node, oldest first
+static uint8_t n_tx_deferred; //!< Number of deferred frames
+
+static ucan_stats_t ucan_stats; //!< Traffic counters
 
 
 /* ----- Functions -----------------------------------------------------------*/
 
+/**
+ * @brief      Returns the time until the last frame to the node of a message is at least NODE_GAP ticks ago
+ * @type       static
+ * @param[in]  msg_id     Id of the message to send
+ * @return     The remaining ticks, 0 if the message can be sent
+ **/
+static TickType_t ucan_node_gap(uint16_t msg_id)
+{
+    TickType_t elapsed = xTaskGetTickCount() - node_last_sent[(msg_id >> 4) % NODE_COUNT];
+
+    return elapsed < NODE_GAP ? NODE_GAP - elapsed : 0;
+}
+
+/**
+ * @brief      Takes the next message which can be sent into tx_frame: the oldest deferred message whose node gap
+ *             is over, otherwise the next one of the transmit queue. A message whose node gap is not over is deferred,
+ *             so the messages to other nodes are not held up. The messages to one node keep their order.
+ * @type       static
+ * @return     true if tx_frame can be sent, false if the caller has to try again
+ **/
+static bool ucan_next_frame(void)
+{
+    TickType_t wait = portMAX_DELAY;
+
+    for(uint8_t i = 0; i < n_tx_deferred; i++) {
+        TickType_t gap = ucan_node_gap(tx_deferred[i].msg.id);
+        if(gap == 0) {
+            tx_frame = tx_deferred[i];
+            n_tx_deferred--;
+            memmove(&tx_deferred[i], &tx_deferred[i + 1], (n_tx_deferred - i) * sizeof(ucan_tx_t));
+            return true;
+        }
+        wait = gap < wait ? gap : wait;
+    }
+
+    if(n_tx_deferred == TX_DEFERRED) { //no space to defer another message, wait for the first gap to end
+        vTaskDelay(wait);
+        return false;
+    }
+    if(xQueueReceive(can_tx_queue, &tx_frame, wait) == pdFALSE) {
+        return false;
+    }
+    for(uint8_t i = 0; i < n_tx_deferred; i++) {
+        if((tx_deferred[i].msg.id >> 4) == (tx_frame.msg.id >> 4)) { //behind an earlier message to the same node
+            tx_deferred[n_tx_deferred++] = tx_frame;
+            return false;
+        }
+    }
+    if(ucan_node_gap(tx_frame.msg.id) > 0) {
+        tx_deferred[n_tx_deferred++] = tx_frame;
+        return false;
+    }
+    return true;
+}
+
 /**
  * @brief      Task which handles the printing of data to the message queue.
+ *             Every message is written once the previous one was transmitted, then the sender is notified.
+ *             A message to a node which got a frame less than NODE_GAP ago waits, the others are sent meanwhile.
  * @type       static
  * @param[in]  *pv_data    Arguments from xTaskCreate
  * @return     none
@@ -65,20 +142,57 @@ static SemaphoreHandle_t can_semaphore; //!< Semaphore for can access
 static void ucan_write_data(void *pv_data)
 {
     while(true) {
-        xQueueReceive(can_tx_queue, &tx_msg, portMAX_DELAY); // get latest message from queue
-
-        /* check if semaphore is already taken */
-        if(xSemaphoreTake(can_semaphore, portMAX_DELAY) == pdTRUE) {
-            CARME_CAN_Write(&tx_msg); // Send message to CAN BUS
-            xSemaphoreGive(can_semaphore); //return semaphore
-            LOG_IF(UCAN_LOG_SENT,DISPLAY_NEWLINE, "Sent msg_id 0x%03x to can", tx_msg.id); // Log message to display
+        if(!ucan_next_frame()) { // get the next message which can be sent
+            continue;
         }
+        ulTaskNotifyTake(pdTRUE, 0); // forget a late transmit interrupt of the previous message
+
+        /* the chip is also accessed by the interrupt, so lock it out while we talk to the chip */
+        taskENTER_CRITICAL();
+        CARME_CAN_Write(&tx_frame.msg); // Send message to CAN BUS
+        taskEXIT_CRITICAL();
+        bool transmitted = ulTaskNotifyTake(pdTRUE, TX_TIMEOUT) > 0; // the chip reports a transmission only when it was acknowledged
+
+        node_last_sent[(tx_frame.msg.id >> 4) % NODE_COUNT] = xTaskGetTickCount();
+        ucan_stats.sent++;
+        if(!transmitted) {
+            ucan_stats.tx_timeouts++;
+            LOG(UCAN, LOG_WARN, DISPLAY_NEWLINE, "No transmit complete for msg_id 0x%03x", tx_frame.msg.id);
+        }
+        if(tx_frame.sender != NULL) {
+            xTaskNotify(tx_frame.sender, transmitted, eSetValueWithOverwrite);
+        }
+        LOG(UCAN, LOG_TRACE, DISPLAY_NEWLINE, "Sent msg_id 0x%03x to can", tx_frame.msg.id); // Log message to display
     }
 }
 
+/**
+ * @brief      Callback of the CAN transmit interrupt. Wakes up the write task.
+ * @type       static
+ * @return     none
+ **/
+static void ucan_tx_irq(void)
+{
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(can_write_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * @brief      Callback of the CAN receive interrupt. Wakes up the read task.
+ * @type       static
+ * @return     none
+ **/
+static void ucan_rx_irq(void)
+{
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(can_read_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
 /**
  * @brief      Task which reads can messages and sends them to the can message
- *             queue
+ *             queue. Sleeps until the receive interrupt fires and then empties the receive fifo of the chip.
  * @type       static
  * @param[in]  *pv_data   Arguments from xTaskCreate
  * @return     none
@@ -86,16 +200,18 @@ static void ucan_write_data(void *pv_data)
 static void ucan_read_data(void *pv_data)
 {
     while(true) {
-        /* check if semaphore is already taken */
-        if(xSemaphoreTake(can_semaphore, portMAX_DELAY) == pdTRUE) {
-            if (CARME_CAN_Read(&rx_msg) == CARME_NO_ERROR) {
-                xSemaphoreGive(can_semaphore); //return semaphore
-                LOG_IF(UCAN_LOG_RECEIVE,DISPLAY_NEWLINE, "Got msg_id 0x%03x", rx_msg.id); // Log message to display
-                xQueueSend(can_rx_queue, &rx_msg, portMAX_DELAY);
-            } else {
-                xSemaphoreGive(can_semaphore); //return semaphore
+        ulTaskNotifyTake(pdTRUE, RX_POLL_PERIOD);
+
+        while(true) {
+            taskENTER_CRITICAL();
+            ERROR_CODES result = CARME_CAN_Read(&rx_msg);
+            taskEXIT_CRITICAL();
+            if(result != CARME_NO_ERROR) {
+                break; // fifo empty
             }
-            vTaskDelay(100);
+            ucan_stats.received++;
+            LOG(UCAN, LOG_TRACE, DISPLAY_NEWLINE, "Got msg_id 0x%03x", rx_msg.id); // Log message to display
+            xQueueSend(can_rx_queue, &rx_msg, portMAX_DELAY);
         }
     }
 }
@@ -121,14 +237,16 @@ static void ucan_dispatch_data(void *pv_data)
             if((tmp_msg.id & message_map[i].mask) == message_map[i].message_id) {
                 queue = message_map[i].queue;
                 match = true;
-                LOG_IF(UCAN_LOG_DISPATCH, DISPLAY_NEWLINE, "Dispatched msg_id 0x%03x", tmp_msg.id);
+                ucan_stats.dispatched++;
+                LOG(UCAN, LOG_TRACE, DISPLAY_NEWLINE, "Dispatched msg_id 0x%03x", tmp_msg.id);
                 xQueueSend(queue, &tmp_msg, portMAX_DELAY); // forward it to the queue
             }
         }
 
         /* if there were no matches, drop messages */
         if(!match) {
-            LOG_IF(UCAN_LOG_DROP,DISPLAY_NEWLINE, "Dropped msg_id 0x%03x", tmp_msg.id);
+            ucan_stats.dropped++;
+            LOG(UCAN, LOG_DEBUG, DISPLAY_NEWLINE, "Dropped msg_id 0x%03x", tmp_msg.id);
         }
     }
 }
@@ -204,6 +322,19 @@ bool ucan_link_message_to_queue(uint16_t message_id, QueueHandle_t queue)
     return ucan_link_message_to_queue_mask(0x0FFF, message_id, queue);
 }
 
+/**
+ * @brief       Returns a copy of the traffic counters
+ * @type        global
+ * @param[out]  *stats          Buffer for the counters
+ * @return      none
+ **/
+void ucan_get_stats(ucan_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    memcpy(stats, &ucan_stats, sizeof(ucan_stats_t));
+    taskEXIT_CRITICAL();
+}
+
 /**
  * @brief       Initialize the hardware and call each init function
  * @type        global
@@ -222,8 +353,9 @@ bool ucan_init(void)
     g.GPIO_PuPd = GPIO_PuPd_NOPULL;
     GPIO_Init(GPIOA, &g);
 
-    /* Init can chip */
-    CARME_CAN_Init(CARME_CAN_BAUD_250K, CARME_CAN_DF_RESET);
+    /* Init can chip, with the receive and transmit interrupts */
+    CARME_CAN_InitI(CARME_CAN_BAUD_250K, CARME_CAN_DF_RESET, CARME_CAN_INT_RX | CARME_CAN_INT_TX);
+    NVIC_SetPriority(CARME_CAN_nCAN_IRQn_CH, RX_IRQ_PRIORITY);
     CARME_CAN_SetMode(CARME_CAN_DF_NORMAL);
 
     /* Setup acceptance filter, unused in the scope of this project*/
@@ -232,27 +364,50 @@ bool ucan_init(void)
     /* Clear the rx and tx CAN message */
     for(int i = 0; i < 7; i++) {
         rx_msg.data[i] = 0;
-        tx_msg.data[i] = 0;
+        tx_frame.msg.data[i] = 0;
     }
 
     /* Create message queues for can communication */
-    can_tx_queue = xQueueCreate(QUEUE_SIZE, sizeof(CARME_CAN_MESSAGE));
+    can_tx_queue = xQueueCreate(QUEUE_SIZE, sizeof(ucan_tx_t));
     can_rx_queue = xQueueCreate(QUEUE_SIZE, sizeof(CARME_CAN_MESSAGE));
 
-    /* create binary semaphore */
-    can_semaphore = xSemaphoreCreateBinary();
-    xSemaphoreGive(can_semaphore);
-
     n_message_map = 0;
 
     /* Spawn tasks */
-    xTaskCreate(ucan_write_data, "CAN_Write_Task", STACKSIZE_TASK, NULL, PRIORITY_TASK, NULL);
-    xTaskCreate(ucan_read_data, "CAN_Read_Task", STACKSIZE_TASK, NULL, PRIORITY_TASK, NULL);
+    xTaskCreate(ucan_write_data, "CAN_Write_Task", STACKSIZE_TASK, NULL, PRIORITY_TASK, &can_write_task);
+    CARME_CAN_RegisterIRQCallback(CARME_CAN_IRQID_TX_INTERRUPT, ucan_tx_irq);
+    xTaskCreate(ucan_read_data, "CAN_Read_Task", STACKSIZE_TASK, NULL, PRIORITY_TASK, &can_read_task);
+    CARME_CAN_RegisterIRQCallback(CARME_CAN_IRQID_RX_INTERRUPT, ucan_rx_irq);
     xTaskCreate(ucan_dispatch_data, "CAN_Dispatch_Task", STACKSIZE_TASK, NULL, PRIORITY_TASK, NULL);
 
     return true;
 }
 
+/**
+ * @brief       Puts a message into the transmit queue
+ * @type        static
+ * @param[in]   n_data_bytes    Size of the payload in bytes
+ * @param[in]   message_id      Id of the message
+ * @param[in]   *data           Payload data to transmit
+ * @param[in]   sender          Task to notify when the message was transmitted, or NULL
+ * @return      none
+ **/
+static void ucan_queue_data(uint8_t n_data_bytes, uint16_t msg_id, const uint8_t *data, TaskHandle_t sender)
+{
+    ucan_tx_t tmp_frame;
+
+    /* Setup basic CAN message header for temporary message */
+    tmp_frame.msg.id = msg_id; // Message ID
+    tmp_frame.msg.rtr = 0; // Something weird
+    tmp_frame.msg.ext = 0; // Something weird
+    tmp_frame.msg.dlc = n_data_bytes; // Number of bytes
+    tmp_frame.sender = sender;
+
+    memcpy(tmp_frame.msg.data, data, min(n_data_bytes, 8)); // copy databytes to output buffer but only 8bytes
+    LOG(UCAN, LOG_TRACE, DISPLAY_NEWLINE, "Insert msg_id 0x%03x to queue", msg_id); // Log message to display
+    xQueueSend(can_tx_queue, &tmp_frame, portMAX_DELAY); // Send message to the message queue
+}
+
 /**
  * @brief       Send data to the can output message queue
  * @type        global
@@ -263,19 +418,30 @@ bool ucan_init(void)
  **/
 bool ucan_send_data(uint8_t n_data_bytes, uint16_t msg_id, const uint8_t *data)
 {
-    CARME_CAN_MESSAGE tmp_msg;
-
-    /* Setup basic CAN message header for temporary message */
-    tmp_msg.id = msg_id; // Message ID
-    tmp_msg.rtr = 0; // Something weird
-    tmp_msg.ext = 0; // Something weird
-    tmp_msg.dlc = n_data_bytes; // Number of bytes
+    ucan_queue_data(n_data_bytes, msg_id, data, NULL);
+    return true;
+}
 
-    memcpy(tmp_msg.data, data, min(n_data_bytes, 8)); // copy databytes to output buffer but only 8bytes
-    LOG_IF(UCAN_LOG_SENDING,DISPLAY_NEWLINE, "Insert msg_id 0x%03x to queue", msg_id); // Log message to display
-    xQueueSend(can_tx_queue, &tmp_msg, portMAX_DELAY); // Send message to the message queue
+/**
+ * @brief       Send data and wait until it was transmitted and acknowledged on the bus.
+ *              Uses the task notification of the calling task.
+ * @type        global
+ * @param[in]   n_data_bytes    Size of the payload in bytes
+ * @param[in]   message_id      Id of the message
+ * @param[in]   *data           Payload data to transmit
+ * @param[in]   timeout         Max time in ticks to wait (including the messages queued before)
+ * @return      True if the message was transmitted, false if it was not acknowledged or the timeout elapsed
+ **/
+bool ucan_send_data_wait(uint8_t n_data_bytes, uint16_t msg_id, const uint8_t *data, TickType_t timeout)
+{
+    uint32_t transmitted = 0;
 
-    return true;
+    xTaskNotifyWait(0, UINT32_MAX, NULL, 0); // clear a notification of an earlier message that timed out
+    ucan_queue_data(n_data_bytes, msg_id, data, xTaskGetCurrentTaskHandle());
+    if(xTaskNotifyWait(0, UINT32_MAX, &transmitted, timeout) == pdFALSE) {
+        return false;
+    }
+    return transmitted != 0;
 }
 
 /*@}*/
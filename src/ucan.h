@@ -15,24 +15,29 @@
 #include <task.h>
 #include <semphr.h>
 
-#include "display.h"
+#include "loglevel.h"
 
 /*----- Defines --------------------------------------------------------------*/
 
-#define UCAN_LOG_SENT 0 //!< Enable or disable logging by setting this to either true or false
-#define UCAN_LOG_SENDING 0 //!< Set loglevel to sent messages
-#define UCAN_LOG_RECEIVE 0 //!< Set loglevel to recieved messages
-#define UCAN_LOG_DISPATCH 0 //!< Set loglevel to dispatched messages
-#define UCAN_LOG_DROP 0 //!< Set loglevel to dropped messages (unable to dispatch)
-
-#define LOG_IF(cond,...) do{ if(cond) display_log(__VA_ARGS__); } while(false) // Write to log using loglevels
-
 /*----- Data types -----------------------------------------------------------*/
 
+/**
+ * @brief   Counters of the CAN traffic handled by ucan
+ **/
+typedef struct {
+    uint32_t sent; //!< Number of messages written to the CAN bus
+    uint32_t received; //!< Number of messages read from the CAN bus
+    uint32_t dispatched; //!< Number of messages forwarded to a linked queue
+    uint32_t dropped; //!< Number of received messages without a linked queue
+    uint32_t tx_timeouts; //!< Number of messages without transmit complete (not acknowledged on the bus)
+} ucan_stats_t;
+
 /*----- Function prototypes --------------------------------------------------*/
 bool ucan_init(void);
 bool ucan_send_data(uint8_t n_data_bytes, uint16_t msg_id, const uint8_t *data);
+bool ucan_send_data_wait(uint8_t n_data_bytes, uint16_t msg_id, const uint8_t *data, TickType_t timeout);
 bool ucan_link_message_to_queue(uint16_t message_id, QueueHandle_t queue);
 bool ucan_link_message_to_queue_mask(uint16_t mask, uint16_t message_id, QueueHandle_t queue);
+void ucan_get_stats(ucan_stats_t *stats);
 
 #endif // UCAN_H
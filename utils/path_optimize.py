@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+#
+#   Shortens the waypoint tables of the arms (see src/topology.c) by merging moves.
+#
+#   A via-point (a waypoint where the gripper does not act, see arm_is_via_point in src/arm.c) is removed
+#   when the direct move between its neighbours is allowed:
+#     - the base only turns while the arm is lifted: the shoulder of both ends is at most --safe-shoulder
+#       (the highest shoulder value at which the original tables turn the base)
+#     - the airspace zones of a removed waypoint are added to the next waypoint, so the arm still holds them
+#   Of all allowed combinations the one with the shortest predicted cycle is printed, in the format of
+#   topology.c. The time of a move is predicted like src/motion.c: the slowest joint counts, each joint
+#   needs offset + slope * distance. The default is the untrained model (25 ms per unit); pass the output
+#   of telemetry_decode.py with --model to use the model measured on the cell.
+#
+#   Usage: path_optimize.py [--topology src/topology.c] [--model decoded.txt] [--safe-shoulder 0x19]
+#
+#   Check the result with the simulator (sim/) before it is loaded onto the cell.
+#
+
+import argparse
+import itertools
+import re
+import sys
+
+AXES = 6
+GRIPPER = 5
+BASE = 1
+SHOULDER = 2
+DEFAULT_SLOPE = 25.0  # MOTION_DEFAULT_SLOPE
+STOP_TIME = 1100  # ARM_SETTLE_TIME + TASK_DELAY
+
+
+def parse_defines(path):
+    defines = {}
+    for name, value in re.findall(r'#define\s+(\w+)\s+\(?(-?(?:0x)?[0-9A-Fa-f]+)\)?', open(path).read()):
+        defines[name] = int(value, 0)
+    return defines
+
+
+def parse_topology(path, defines):
+    """Returns [(arm name, waypoints, zones)] in the order of topology_arms."""
+    text = open(path).read()
+    tables = {}
+    for name, body in re.findall(r'uint8_t\s+(\w+)\[\]\[TOPOLOGY_AXES\]\s*=\s*\{(.*?)\};', text, re.S):
+        body = re.sub(r'/\*.*?\*/|//[^\n]*', '', body, flags=re.S)
+        tables[name] = [[int(v, 0) for v in row.split(',')] for row in re.findall(r'\{([^{}]*)\}', body)]
+    zones = {}
+    for name, body in re.findall(r'const\s+uint8_t\s+(\w+)\[\]\s*=\s*\{(.*?)\};', text, re.S):
+        body = re.sub(r'/\*.*?\*/|//[^\n]*', '', body, flags=re.S)
+        values = []
+        for entry in body.split(','):
+            if entry.strip():
+                values.append(eval(entry.strip(), {}, defines))  # only numbers, | and the TOPOLOGY_ZONE_* names
+        zones[name] = values
+    arms = []
+    for index, name, waypoints, zone in re.findall(
+            r'\[(\w+)\]\s*=\s*\{"([^"]+)",[^}]*?(waypoints_\w+),[^}]*?(zones_\w+)', text, re.S):
+        arms.append((defines.get(index, len(arms)), name, waypoints, tables[waypoints], zone, zones[zone]))
+    return sorted(arms)
+
+
+def parse_model(path):
+    """Reads the joint models from the output of telemetry_decode.py: {(arm, joint): (offset, slope)}."""
+    model = {}
+    pattern = re.compile(r'arm (\d+) joint (\d+): (-?\d+) ms \+ ([\d.]+) ms/unit')
+    for line in open(path):
+        match = pattern.search(line)
+        if match:
+            model[(int(match.group(1)), int(match.group(2)))] = (int(match.group(3)), float(match.group(4)))
+    return model
+
+
+def signed(value):
+    return value - 256 if value >= 128 else value  # the joints are signed bytes
+
+
+def move_time(model, arm, a, b):
+    longest = 0
+    for joint in range(1, AXES):
+        distance = abs(signed(a[joint]) - signed(b[joint]))
+        if distance:
+            offset, slope = model.get((arm, joint), (0, DEFAULT_SLOPE))
+            longest = max(longest, offset + slope * distance)
+    return longest
+
+
+def is_via_point(waypoints, n):
+    count = len(waypoints)
+    gripper = waypoints[n][GRIPPER]
+    return gripper == waypoints[(n - 1) % count][GRIPPER] == waypoints[(n + 1) % count][GRIPPER]
+
+
+def cycle_time(model, arm, waypoints):
+    total = 0
+    for n in range(len(waypoints)):
+        total += move_time(model, arm, waypoints[n - 1], waypoints[n])
+        if not is_via_point(waypoints, n):
+            total += STOP_TIME
+    return total
+
+
+def blocked(a, b, safe_shoulder):
+    """Returns why the direct move from a to b is not allowed, or None."""
+    if a[BASE] != b[BASE] and max(a[SHOULDER], b[SHOULDER]) > safe_shoulder:
+        return 'turns the base with the shoulder at 0x%02x' % max(a[SHOULDER], b[SHOULDER])
+    return None
+
+
+def pinned(waypoints):
+    """Returns the waypoints right after the gripper acted, at which the arm tells the belts that the block
+    is off the source or on the target (see arm_find_roles in src/arm.c). They are kept."""
+    return [(n + 1) % len(waypoints) for n in range(len(waypoints)) if waypoints[n][GRIPPER] != waypoints[n - 1][GRIPPER]]
+
+
+def optimize(model, arm, waypoints, zones, safe_shoulder):
+    """Returns (kept indices, merged zones) of the fastest allowed table."""
+    count = len(waypoints)
+    candidates = [n for n in range(count) if is_via_point(waypoints, n) and n not in pinned(waypoints)]
+    best = None
+    for size in range(len(candidates) + 1):
+        for removed in itertools.combinations(candidates, size):
+            kept = [n for n in range(len(waypoints)) if n not in removed]
+            rows = [waypoints[n] for n in kept]
+            if any(blocked(rows[i - 1], rows[i], safe_shoulder) for i in range(len(rows))):
+                continue
+            if [n for n in range(len(rows)) if not is_via_point(rows, n)] != \
+                    [i for i, n in enumerate(kept) if not is_via_point(waypoints, n)]:
+                continue  # a via-point would become a stop point
+            time = cycle_time(model, arm, rows)
+            if best is None or time < best[0] - 0.5:
+                best = (time, kept)
+    kept = best[1]
+    merged = []
+    for i, n in enumerate(kept):
+        m = (kept[i - 1] + 1) % len(waypoints)  # the removed waypoints before n, and n
+        value = zones[n]
+        while m != n:
+            value |= zones[m]
+            m = (m + 1) % len(waypoints)
+        merged.append(value)
+    return kept, merged
+
+
+def zone_names(value, defines):
+    names = [name for name, bit in sorted(defines.items(), key=lambda item: item[1])
+             if name.startswith('TOPOLOGY_ZONE_') and value & bit]
+    return ' | '.join(names) if names else '0'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Merges the moves of the arm waypoint tables')
+    parser.add_argument('--topology', default='src/topology.c')
+    parser.add_argument('--header', default=None, help='topology.h, default: next to --topology')
+    parser.add_argument('--model', help='output of telemetry_decode.py with the motion frames')
+    parser.add_argument('--safe-shoulder', type=lambda v: int(v, 0), default=0x19)
+    args = parser.parse_args()
+
+    header = args.header or re.sub(r'\.c$', '.h', args.topology)
+    defines = parse_defines(header)
+    model = parse_model(args.model) if args.model else {}
+
+    for arm, name, table, waypoints, zone_table, zones in parse_topology(args.topology, defines):
+        for i in range(len(waypoints)):
+            reason = blocked(waypoints[i - 1], waypoints[i], args.safe_shoulder)
+            if reason:
+                print('%s: original move to waypoint %u %s, raise --safe-shoulder' % (name, i, reason), file=sys.stderr)
+
+        kept, merged = optimize(model, arm, waypoints, zones, args.safe_shoulder)
+        before = cycle_time(model, arm, waypoints)
+        after = cycle_time(model, arm, [waypoints[n] for n in kept])
+        removed = [n for n in range(len(waypoints)) if n not in kept]
+
+        print('/* %s: cycle %.1f s -> %.1f s, removed waypoints %s */' % (
+            name, before / 1000, after / 1000, ', '.join('%u' % n for n in removed) or 'none'))
+        rows = [waypoints[n] for n in kept]
+        for i, n in enumerate(kept):
+            if is_via_point(waypoints, n) and n not in pinned(waypoints):
+                reason = blocked(rows[i - 1], rows[(i + 1) % len(rows)], args.safe_shoulder)
+                if reason:
+                    print('/* waypoint %u kept: the direct move %s */' % (n, reason))
+        print('static uint8_t %s[][TOPOLOGY_AXES] = {' % table)
+        print('    /*Arm    B     S     E     H     G */')
+        for n in kept:
+            print('    {%s}, //%u' % (', '.join('0x%02X' % v for v in waypoints[n]), n))
+        print('};\n')
+        print('static const uint8_t %s[] = {' % zone_table)
+        for n, value in zip(kept, merged):
+            print('    %s, //%u' % (zone_names(value, defines), n))
+        print('};\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+#
+#   Decoder for the binary telemetry stream of the ubor controller (see src/telemetry.c).
+#
+#   Usage: telemetry_decode.py /dev/ttyUSB0 [baudrate]   (needs pyserial)
+#          telemetry_decode.py capture.bin               (decode a recorded stream)
+#
+
+import struct
+import sys
+
+SOF = 0xA5
+TYPE_LOG = 0x01
+TYPE_UCAN_STATS = 0x02
+TYPE_METRICS = 0x03
+TYPE_MOTION = 0x04
+
+MAX_BELTS = 8  # TOPOLOGY_MAX_BELTS, stations above are arms
+BCS_STAGES = ['reset', 'drop', 'start', 'detect', 'dispatch', 'done', 'recovery', 'end', 'target']
+ARM_WAIT = 15  # METRICS_ARM_WAIT
+ARM_AIRSPACE = 14  # METRICS_ARM_AIRSPACE
+ARM_STAGES = {ARM_WAIT: 'wait', ARM_AIRSPACE: 'air'}
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def frames(read):
+    """Yields (type, seq, payload) for every valid frame. Resynchronizes on the start marker."""
+    buf = bytearray()
+    eof = False
+    while not eof or buf:
+        chunk = read(256)
+        eof = not chunk
+        buf += chunk
+        while True:
+            start = buf.find(SOF)
+            if start < 0:
+                buf.clear()
+                break
+            del buf[:start]
+            if len(buf) < 5 or len(buf) < buf[3] + 5:
+                if eof:  # incomplete at the end of the stream: can only be a false start marker
+                    del buf[:1]
+                    continue
+                break
+            length = buf[3]
+            frame = bytes(buf[:length + 5])
+            if crc8(frame[1:-1]) != frame[-1]:
+                del buf[:1]  # not a frame start, search the next marker
+                continue
+            del buf[:length + 5]
+            yield frame[1], frame[2], frame[4:-1]
+
+
+def format_frame(frame_type, payload):
+    if frame_type == TYPE_LOG:
+        tick, = struct.unpack_from('<I', payload)
+        name, _, message = payload[4:].partition(b'\0')
+        return '%10u %s: %s' % (tick, name.decode(errors='replace'), message.decode(errors='replace'))
+    if frame_type == TYPE_UCAN_STATS:
+        tick, sent, received, dispatched, dropped, lost = struct.unpack_from('<6I', payload)
+        return '%10u ucan: sent %u received %u dispatched %u dropped %u (telemetry frames lost %u)' % (
+            tick, sent, received, dispatched, dropped, lost)
+    if frame_type == TYPE_METRICS:
+        tick, station, stage, count, total, low, high = struct.unpack_from('<IBBIIHH', payload)
+        histogram = struct.unpack_from('<12H', payload, 18)
+        if station < MAX_BELTS:
+            name = 'belt %u %s' % (station, BCS_STAGES[stage] if stage < len(BCS_STAGES) else stage)
+        else:
+            name = 'arm %u %s' % (station - MAX_BELTS, ARM_STAGES.get(stage, 'wp%u' % stage))
+        buckets = ' '.join('%u' % n for n in histogram)
+        return '%10u %s: n %u min %u avg %u max %u ms, histogram (0, 1, 2-3, 4-7 .. >=1024 ms) %s' % (
+            tick, name, count, low, total // max(count, 1), high, buckets)
+    if frame_type == TYPE_MOTION:
+        tick, arm, joint, samples, offset, slope = struct.unpack_from('<IBBHii', payload)
+        return '%10u arm %u joint %u: %d ms + %.2f ms/unit (%u samples)' % (tick, arm, joint, offset, slope / 256.0, samples)
+    return 'unknown frame type 0x%02x: %s' % (frame_type, payload.hex())
+
+
+def main():
+    if len(sys.argv) < 2:
+        print('usage: telemetry_decode.py <port|file> [baudrate]')
+        sys.exit(1)
+
+    path = sys.argv[1]
+    if path.startswith('/dev/') or path.startswith('COM'):
+        import serial
+        port = serial.Serial(path, int(sys.argv[2]) if len(sys.argv) > 2 else 921600, timeout=None)
+        read = lambda size: port.read(max(1, port.in_waiting))  # return as soon as anything arrived
+    else:
+        read = open(path, 'rb').read
+
+    expected_seq = None
+    for frame_type, seq, payload in frames(read):
+        if expected_seq is not None and seq != expected_seq:
+            print('-- %u frame(s) lost' % ((seq - expected_seq) & 0xFF))
+        expected_seq = (seq + 1) & 0xFF
+        print(format_frame(frame_type, payload))
+
+
+if __name__ == '__main__':
+    main()